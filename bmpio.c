@@ -21,6 +21,9 @@ type:
 // Worst case, file header size + v4 info header size + 256 4byte palette.
 #define MAX_HEADER_SIZE (14 + 108 + 256 * 4)
 
+// Read ahead buffer size for the pixel data.
+#define READ_BUFFER_SIZE (256 * 1024)
+
 #define headerSTART(D)           (D)->hptr = (D)->header;
 #define headerSKIP(D, COUNT)     (D)->hptr += COUNT
 
@@ -188,7 +191,20 @@ typedef struct
    Gn1            header[MAX_HEADER_SIZE];
    Gn1           *hptr;
 
+   // Row table and the one slab the rows live in.  Reading, isRead once 
+   // the pixels are in them.
+   Gb             isRead;
    Gn1          **row;
+   Gcount         rowCapacity;
+   Gn1           *rowSlab;
+   Gsize          rowSlabSize;
+
+   // Read ahead buffer for the pixel data.  The readers take their bytes 
+   // straight out of here instead of reading the file in small pieces.
+   Gn1           *readBuffer;
+   Gcount         readBufferSize;
+   Gcount         readCount;
+   Gindex         readIndex;
 } Bmpio;
 
 /******************************************************************************
@@ -200,6 +216,7 @@ static void _BmpDestroyContent(  Gimgio * const img);
 static Gb   _BmpGetPixelRow(     Gimgio * const img, void * const pixel);
 
 static Gb   _BmpReadStart(       Gimgio * const img);
+static Gb   _BmpReset(           Gimgio * const img);
 
 static Gb   _BmpSetImageIndex(   Gimgio * const img, Gi4 const index);
 static Gb   _BmpSetPixelRow(     Gimgio * const img, void * const pixel);
@@ -223,6 +240,7 @@ static Gb   _ReadBmpRLE24(       Gimgio * const img, Bmpio * const data);
 static Gb   _ReadBmpBitField16(  Gimgio * const img, Bmpio * const data);
 static Gb   _ReadBmpBitField32(  Gimgio * const img, Bmpio * const data);
 static void _ReadBmpBitFieldInfo(Bmpio * const data, Gn4 const mask, Gn4 * const newMask, Gn4 * const offset);
+static Gn1 const *_ReadGet(      Gimgio * const img, Bmpio * const data, Gcount const count);
 static Gb   _ReadMask(           Gimgio * const img, Bmpio * const data);
 static Gb   _ReadPalette(        Gimgio * const img, Bmpio * const data);
 
@@ -243,13 +261,14 @@ Gb bmpioCreateContent(Gimgio * const img)
 
    genter;
 
-   data = gmemCreateType(Bmpio);
+   data = memioCreateType(img->memory, Bmpio);
    greturnFalseIf(!data);
 
    img->data           = data;
    img->DestroyContent = _BmpDestroyContent;
    img->GetPixelRow    = _BmpGetPixelRow;
    img->ReadStart      = _BmpReadStart;
+   img->Reset          = _BmpReset;
    img->SetImageIndex  = _BmpSetImageIndex;
    img->SetPixelRow    = _BmpSetPixelRow;
    img->SetTypeFile    = _BmpSetTypeFile;
@@ -274,17 +293,18 @@ static void _BmpDestroyContent(Gimgio * const img)
 
    data = (Bmpio *) img->data;
 
-   // Write out the image
-   if (img->mode == gimgioOpenWRITE)
+   // Write out the image.  Nothing to write when no row was ever set.
+   if (img->mode == gimgioOpenWRITE &&
+       data->row)
    {
       _WriteBmp(img, data);
    }
 
    _DestroyRowPointers(img, data);
    
-   gmemDestroy(data->palette);
+   memioDestroyBuffer(img->memory, data->palette);
 
-   gmemDestroy(img->data);
+   memioDestroyBuffer(img->memory, img->data);
    img->data = NULL;
 
    greturn;
@@ -303,7 +323,7 @@ static Gb _BmpGetPixelRow(Gimgio * const img, void * const pixel)
 
    data = (Bmpio *) img->data;
 
-   if (!data->row)
+   if (!data->isRead)
    {
       greturnFalseIf(!_ReadBmp(img, data));
    }
@@ -334,7 +354,7 @@ static Gb _BmpReadStart(Gimgio * const img)
    data = (Bmpio *) img->data;
 
    // Read in all the header information in one read.
-   gfileGet(img->file, MAX_HEADER_SIZE, data->header);
+   streamioGet(img->stream, MAX_HEADER_SIZE, data->header);
 
    headerSTART(data);
 
@@ -439,8 +459,63 @@ static Gb _BmpReadStart(Gimgio * const img)
       }
    }
 
+   // Only up to 8 bits use the palette.  0 colors used means all of them.
+   // More than the bits can index is more than the header has room for.
+   if (data->ibpp <= 8)
+   {
+      if (data->paletteCount == 0 ||
+          data->paletteCount > (Gn4) (1 << data->ibpp))
+      {
+         data->paletteCount = 1 << data->ibpp;
+      }
+   }
+   else
+   {
+      data->paletteCount = 0;
+   }
+
    greturnFalseIf(!_ReadPalette(img, data));
 
+   // All bmp variants are read in as RGB N1.  The pixels themselves are only
+   // read when the first row is asked for.
+   img->typeFile   = gimgioTypeRGB | gimgioTypeN1;
+   img->imageCount = 1;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _BmpReset
+
+Ready for the next file.  The row table and slab are kept.
+******************************************************************************/
+static Gb _BmpReset(Gimgio * const img)
+{
+   Bmpio  *data;
+   Gn1   **row;
+   Gcount  rowCapacity;
+   Gn1    *rowSlab;
+   Gsize   rowSlabSize;
+
+   genter;
+
+   data = (Bmpio *) img->data;
+
+   memioDestroyBuffer(img->memory, data->palette);
+   memioDestroyBuffer(img->memory, data->readBuffer);
+
+   row         = data->row;
+   rowCapacity = data->rowCapacity;
+   rowSlab     = data->rowSlab;
+   rowSlabSize = data->rowSlabSize;
+
+   gmemClear(data, gsizeof(Bmpio));
+
+   data->row         = row;
+   data->rowCapacity = rowCapacity;
+   data->rowSlab     = rowSlab;
+   data->rowSlabSize = rowSlabSize;
+
    greturn gbTRUE;
 }
 
@@ -508,23 +583,52 @@ static Gb _BmpSetTypeFile(Gimgio * const img)
 /******************************************************************************
 func: _CreateRowPointers
 
-Create the row pointers.
+Create the row pointers.  All rows live in one slab.  Each row is padded to 
+16 bytes so rows stay aligned for the row kernels.  An existing slab and row
+table are reused when they are big enough.
 ******************************************************************************/
 static Gb _CreateRowPointers(Gimgio * const img, Bmpio * const data, Gi4 const rowSize)
 {
-   Gi4 a;
+   Gi4   a;
+   Gsize rowSizePadded;
 
    genter;
 
-   // Allocate the 'row pointers', image buffer.
-   data->row = gmemCreateTypeArray(Gn1 *, img->height);
-   greturnFalseIf(!data->row);
+   rowSizePadded = (rowSize + 15) & ~15;
+
+   // Allocate the 'row pointers'.
+   if (data->rowCapacity < img->height)
+   {
+      memioDestroyBuffer(img->memory, data->row);
+      data->rowCapacity = 0;
+
+      data->row = memioCreateTypeArray(img->memory, Gn1 *, img->height);
+      greturnFalseIf(!data->row);
+
+      data->rowCapacity = img->height;
+   }
 
-   // Allocate the rows.
+   // Allocate the image buffer.
+   if (data->rowSlabSize < rowSizePadded * img->height)
+   {
+      memioDestroyBuffer(img->memory, data->rowSlab);
+      data->rowSlabSize = 0;
+
+      data->rowSlab = memioCreateTypeArray(img->memory, Gn1, rowSizePadded * img->height);
+      greturnFalseIf(!data->rowSlab);
+
+      data->rowSlabSize = rowSizePadded * img->height;
+   }
+   else
+   {
+      // Reused, start from a clean image like a new allocation would.
+      gmemClear(data->rowSlab, rowSizePadded * img->height);
+   }
+
+   // Point the rows into the slab.
    forCount(a, img->height)
    {
-      data->row[a] = gmemCreateTypeArray(Gn1, rowSize);
-      greturnFalseIf(!data->row[a]);
+      data->row[a] = &data->rowSlab[rowSizePadded * a];
    }
 
    greturn gbTRUE;
@@ -537,20 +641,15 @@ Destroy the row pointers.
 ******************************************************************************/
 static void _DestroyRowPointers(Gimgio * const img, Bmpio * const data)
 {
-   Gi4 a;
-
    genter;
 
-   if (data->row)
-   {
-      forCount(a, img->height)
-      {
-         gmemDestroy(data->row[a]);
-      }
+   memioDestroyBuffer(img->memory, data->row);
+   memioDestroyBuffer(img->memory, data->rowSlab);
 
-      gmemDestroy(data->row);
-   }
-   data->row = NULL;
+   data->row         = NULL;
+   data->rowCapacity = 0;
+   data->rowSlab     = NULL;
+   data->rowSlabSize = 0;
 
    greturn;
 }
@@ -566,7 +665,7 @@ static Gi4 _GetWidthPadded(Gimgio * const img, Bmpio * const data)
    
    genter;
 
-   widthWithPad = img->width * data->ibpp / 8;
+   widthWithPad = (img->width * data->ibpp + 7) / 8;
    switch(widthWithPad % 4)
    {
    case 1: widthWithPad++;
@@ -590,36 +689,41 @@ static Gb _ReadBmp(Gimgio * const img, Bmpio * const data)
 
    img->typeFile = gimgioTypeRGB | gimgioTypeN1;
 
-   if (!data->row)
-   {
-      greturnFalseIf(
-         !_CreateRowPointers(
-            img, 
-            data, 
-            gimgioGetPixelSize(img->typeFile, img->width)));
-   }
+   // Reuses the rows of an earlier file when they are big enough.
+   greturnFalseIf(
+      !_CreateRowPointers(
+         img, 
+         data, 
+         gimgioGetPixelSize(img->typeFile, img->width)));
+
+   greturnFalseIf(!streamioSetPosition(img->stream, data->fimageOffset));
 
-   gfileSetPosition(img->file, gpositionSTART, data->fimageOffset);
+   // Set up the read ahead buffer.  It needs to hold at least one row.
+   data->readBufferSize = gMAX(READ_BUFFER_SIZE, _GetWidthPadded(img, data));
+   data->readBuffer     = memioCreateTypeArray(img->memory, Gn1, data->readBufferSize);
+   greturnFalseIf(!data->readBuffer);
+
+   data->readCount = 0;
+   data->readIndex = 0;
+
+   result = gbFALSE;
 
    switch(data->ibpp)
    {
    case 1:
       result = _ReadBmp1(img, data);
-
-      greturn result;
+      break;
 
    case 4:
       switch(data->icompression)
       {
       case bmpCompressionRAW:
          result = _ReadBmp4(img, data);
-
-         greturn result;
+         break;
 
       case bmpCompressionRLE4:
          result = _ReadBmpRLE4(img, data);
-
-         greturn result;
+         break;
       }
       break;
 
@@ -628,43 +732,44 @@ static Gb _ReadBmp(Gimgio * const img, Bmpio * const data)
       {
       case bmpCompressionRAW:
          result = _ReadBmp8(img, data);
-
-         greturn result;
+         break;
 
       case bmpCompressionRLE8:
          result = _ReadBmpRLE8(img, data);
-
-         greturn result;
+         break;
       }
       break;
 
    case 16:
       result = _ReadBmpBitField16(img, data);
-
-      greturn result;
+      break;
 
    case 24:
       switch(data->icompression)
       {
       case bmpCompressionRAW:
          result = _ReadBmp24(img, data);
-
-         greturn result;
+         break;
 
       case bmpCompressionRLE24: // os2 file only
          result = _ReadBmpRLE24(img, data);
-
-         greturn result;
+         break;
       }
       break;
 
    case 32:
       result = _ReadBmpBitField32(img, data);
-
-      greturn result;
+      break;
    }
 
-   greturn gbFALSE;
+   // The whole image is read.  The buffer is no longer needed.
+   memioDestroyBuffer(img->memory, data->readBuffer);
+   data->readBuffer     = NULL;
+   data->readBufferSize = 0;
+
+   data->isRead = result;
+
+   greturn result;
 }
 
 /******************************************************************************
@@ -674,23 +779,22 @@ Read in a 2 color bitmap.
 ******************************************************************************/
 static Gb _ReadBmp1(Gimgio * const img, Bmpio * const data)
 {
-   Gi4  widthWithPad,
-        rindex,
-        cindex,
-        byte,
-        row,
-        bit;
-   Gn1 *pixel; 
+   Gi4        widthWithPad,
+              rindex,
+              cindex,
+              byte,
+              row,
+              bit;
+   Gn1 const *pixel; 
 
    genter;
 
    widthWithPad = _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn1, widthWithPad);
-   greturnFalseIf(!pixel);
 
    forCount(rindex, img->height)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      pixel = _ReadGet(img, data, widthWithPad);
+      greturnFalseIf(!pixel);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -702,6 +806,7 @@ static Gb _ReadBmp1(Gimgio * const img, Bmpio * const data)
       {
          byte = cindex / 8;
          bit  = ((pixel[byte] & (1 << (7 - (cindex % 8)))) == 0) ? 0 : 1;
+         greturnFalseIf((Gn4) bit >= data->paletteCount);
 
          data->row[row][cindex * 3 + 0] = data->palette[bit * 4 + 0];
          data->row[row][cindex * 3 + 1] = data->palette[bit * 4 + 1];
@@ -709,9 +814,6 @@ static Gb _ReadBmp1(Gimgio * const img, Bmpio * const data)
       }
    }
 
-   // Clean up
-   gmemDestroy(pixel);
-
    greturn gbTRUE;
 }
 
@@ -722,23 +824,22 @@ Read in the 16 color image.
 ******************************************************************************/
 static Gb _ReadBmp4(Gimgio * const img, Bmpio * const data)
 {
-   Gi4  widthWithPad,
-        rindex,
-        cindex,
-        byte,
-        row,
-        quadBit;
-   Gn1 *pixel; 
+   Gi4        widthWithPad,
+              rindex,
+              cindex,
+              byte,
+              row,
+              quadBit;
+   Gn1 const *pixel; 
 
    genter;
 
    widthWithPad = _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn1, widthWithPad);
-   greturnFalseIf(!pixel);
 
    forCount(rindex, img->height)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      pixel = _ReadGet(img, data, widthWithPad);
+      greturnFalseIf(!pixel);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -757,6 +858,7 @@ static Gb _ReadBmp4(Gimgio * const img, Bmpio * const data)
          {
             quadBit = pixel[byte] & 0xf;
          }
+         greturnFalseIf((Gn4) quadBit >= data->paletteCount);
 
          data->row[row][cindex * 3 + 0] = data->palette[quadBit * 4 + 0];
          data->row[row][cindex * 3 + 1] = data->palette[quadBit * 4 + 1];
@@ -764,8 +866,6 @@ static Gb _ReadBmp4(Gimgio * const img, Bmpio * const data)
       }
    }
 
-   gmemDestroy(pixel);
-
    greturn gbTRUE;
 }
 
@@ -776,22 +876,21 @@ Read in a 256 color image.
 ******************************************************************************/
 static Gb _ReadBmp8(Gimgio * const img, Bmpio * const data)
 {
-   Gi4  widthWithPad,
-        rindex,
-        cindex,
-        row;
-   Gn1 *pixel,
-        byte; 
+   Gi4        widthWithPad,
+              rindex,
+              cindex,
+              row;
+   Gn1        byte; 
+   Gn1 const *pixel;
 
    genter;
 
    widthWithPad = _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn1, widthWithPad);
-   greturnFalseIf(!pixel);
 
    forCount(rindex, img->height)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      pixel = _ReadGet(img, data, widthWithPad);
+      greturnFalseIf(!pixel);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -802,14 +901,14 @@ static Gb _ReadBmp8(Gimgio * const img, Bmpio * const data)
       forCount(cindex, img->width)
       {
          byte = pixel[cindex];
+         greturnFalseIf(byte >= data->paletteCount);
+
          data->row[row][cindex * 3 + 0] = data->palette[byte * 4 + 0];
          data->row[row][cindex * 3 + 1] = data->palette[byte * 4 + 1];
          data->row[row][cindex * 3 + 2] = data->palette[byte * 4 + 2];
       }
    }
 
-   gmemDestroy(pixel);
-
    greturn gbTRUE;
 }
 
@@ -820,21 +919,22 @@ Read in a 24 bit image.
 ******************************************************************************/
 static Gb _ReadBmp24(Gimgio * const img, Bmpio * const data)
 {
-   Gi4  widthWithPad,
-        rindex,
-        cindex,
-        row;
-   Gn1 *pixel; 
+   Gi4         widthWithPad,
+               rindex,
+               row;
+   Gn1 const  *pixel; 
+   SimdioFunc  swapRB;
 
    genter;
 
    widthWithPad = _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn1, widthWithPad);
-   greturnFalseIf(!pixel);
+
+   swapRB = simdioGetFunc(simdioKernelSWAP_RB);
 
    forCount(rindex, img->height)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      pixel = _ReadGet(img, data, widthWithPad);
+      greturnFalseIf(!pixel);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -842,17 +942,10 @@ static Gb _ReadBmp24(Gimgio * const img, Bmpio * const data)
          row = img->height - 1 - rindex;
       }
 
-      forCount(cindex, img->width)
-      {
-         // BGR to RGB
-         data->row[row][cindex * 3 + 0] = pixel[cindex * 3 + 2];
-         data->row[row][cindex * 3 + 1] = pixel[cindex * 3 + 1];
-         data->row[row][cindex * 3 + 2] = pixel[cindex * 3 + 0];
-      }
+      // BGR to RGB
+      swapRB(img->width, pixel, data->row[row]);
    }
 
-   gmemDestroy(pixel);
-
    greturn gbTRUE;
 }
 
@@ -863,15 +956,15 @@ Read in a RLE compressed 16 color image.
 ******************************************************************************/
 static Gb _ReadBmpRLE4(Gimgio * const img, Bmpio * const data)
 {
-   Gindex loopIndex,
-          rindex,
-          cindex,
-          row,
-          byteIndex,
-          runIndex;
-   Gcount count;
-   Gi4    quadBit;
-   Gn1    byte[256]; 
+   Gindex     loopIndex,
+              rindex,
+              cindex,
+              row,
+              byteIndex,
+              runIndex;
+   Gcount     count;
+   Gi4        quadBit;
+   Gn1 const *byte;
 
    genter;
 
@@ -887,8 +980,12 @@ static Gb _ReadBmpRLE4(Gimgio * const img, Bmpio * const data)
 
    loopCount(loopIndex)
    {
+      // Past the last row, nothing more can be stored.
+      breakIf(rindex >= img->height);
+
       // Read RLE Header and follow byte.
-      gfileGet(img->file, 2, byte);
+      byte = _ReadGet(img, data, 2);
+      greturnFalseIf(!byte);
 
       // Repeat run
       if      (byte[0] > 0)
@@ -907,22 +1004,23 @@ static Gb _ReadBmpRLE4(Gimgio * const img, Bmpio * const data)
                quadBit = byte[1] & 0xf;
             }
 
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+            greturnFalseIf((Gn4) quadBit >= data->paletteCount);
+
             data->row[row][cindex * 3 + 0] = data->palette[quadBit * 4 + 0];
             data->row[row][cindex * 3 + 1] = data->palette[quadBit * 4 + 1];
             data->row[row][cindex * 3 + 2] = data->palette[quadBit * 4 + 2];
             cindex++;
-
-            breakIf(cindex >= img->width);
          }
       }
       // Raw run
       else if (byte[1] >= 3)
       {
+         // Two pixels a byte, padded to a 2 byte boundary.
          count = byte[1];
-         gfileGet(
-            img->file, 
-            ((count / 2) & 1) ? (count / 2) + 1 : (count / 2),
-            byte);
+         byte  = _ReadGet(img, data, (((count + 1) / 2) + 1) & ~1);
+         greturnFalseIf(!byte);
 
          for (runIndex = 0; runIndex < count; runIndex++)
          {
@@ -936,12 +1034,14 @@ static Gb _ReadBmpRLE4(Gimgio * const img, Bmpio * const data)
                quadBit = byte[byteIndex] & 0xf;
             }
 
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+            greturnFalseIf((Gn4) quadBit >= data->paletteCount);
+
             data->row[row][cindex * 3 + 0] = data->palette[quadBit * 4 + 0];
             data->row[row][cindex * 3 + 1] = data->palette[quadBit * 4 + 1];
             data->row[row][cindex * 3 + 2] = data->palette[quadBit * 4 + 2];
             cindex++;
-
-            breakIf(cindex >= img->width);
          }
       }
       // End of scan line.
@@ -965,9 +1065,20 @@ static Gb _ReadBmpRLE4(Gimgio * const img, Bmpio * const data)
       // Move the current pixel.
       else if (byte[1] == 2)
       {
-         gfileGet(img->file, 2, byte);
+         byte = _ReadGet(img, data, 2);
+         greturnFalseIf(!byte);
          cindex += byte[0];
          rindex += byte[1];
+
+         // A move off the side of the image is a broken file.
+         greturnFalseIf(cindex > img->width);
+
+         breakIf(rindex >= img->height);
+         row = rindex;
+         if (data->iisBottomUp)
+         {
+            row = img->height - 1 - rindex;
+         }
       }
    }
 
@@ -981,14 +1092,14 @@ Read in an RLE 8 compressed 256 color image.
 ******************************************************************************/
 static Gb _ReadBmpRLE8(Gimgio * const img, Bmpio * const data)
 {
-   Gindex loopIndex,
-          rindex,
-          cindex,
-          row,
-          byteIndex,
-          runIndex;
-   Gcount count;
-   Gn1    byte[256]; 
+   Gindex     loopIndex,
+              rindex,
+              cindex,
+              row,
+              byteIndex,
+              runIndex;
+   Gcount     count;
+   Gn1 const *byte;
 
    genter;
 
@@ -1004,8 +1115,12 @@ static Gb _ReadBmpRLE8(Gimgio * const img, Bmpio * const data)
 
    loopCount(loopIndex)
    {
+      // Past the last row, nothing more can be stored.
+      breakIf(rindex >= img->height);
+
       // Read RLE Header and follow byte.
-      gfileGet(img->file, 2, byte);
+      byte = _ReadGet(img, data, 2);
+      greturnFalseIf(!byte);
 
       // Repeat run
       if      (byte[0] > 0)
@@ -1013,31 +1128,36 @@ static Gb _ReadBmpRLE8(Gimgio * const img, Bmpio * const data)
          count     = byte[0];
          byteIndex = byte[1];
 
+         greturnFalseIf((Gn4) byteIndex >= data->paletteCount);
+
          for (runIndex = 0; runIndex < count; runIndex++)
          {
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+
             data->row[row][cindex * 3 + 0] = data->palette[byteIndex * 4 + 0];
             data->row[row][cindex * 3 + 1] = data->palette[byteIndex * 4 + 1];
             data->row[row][cindex * 3 + 2] = data->palette[byteIndex * 4 + 2];
             cindex++;
-            breakIf(cindex >= img->width);
          }
       }
       // Raw run
       else if (byte[1] >= 3)
       {
          count = byte[1];
-         gfileGet(
-            img->file, 
-            (count & 1) ? count + 1 : count, 
-            byte);
+         byte  = _ReadGet(img, data, (count & 1) ? count + 1 : count);
+         greturnFalseIf(!byte);
 
          for (runIndex = 0; runIndex < count; runIndex++)
          {
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+            greturnFalseIf(byte[runIndex] >= data->paletteCount);
+
             data->row[row][cindex * 3 + 0] = data->palette[byte[runIndex] * 4 + 0];
             data->row[row][cindex * 3 + 1] = data->palette[byte[runIndex] * 4 + 1];
             data->row[row][cindex * 3 + 2] = data->palette[byte[runIndex] * 4 + 2];
             cindex++;
-            breakIf(cindex >= img->width);
          }
       }
       // End of scan line.
@@ -1061,9 +1181,20 @@ static Gb _ReadBmpRLE8(Gimgio * const img, Bmpio * const data)
       // Move the current pixel.
       else if (byte[1] == 2)
       {
-         gfileGet(img->file, 2, byte);
+         byte = _ReadGet(img, data, 2);
+         greturnFalseIf(!byte);
          cindex += byte[0];
          rindex += byte[1];
+
+         // A move off the side of the image is a broken file.
+         greturnFalseIf(cindex > img->width);
+
+         breakIf(rindex >= img->height);
+         row = rindex;
+         if (data->iisBottomUp)
+         {
+            row = img->height - 1 - rindex;
+         }
       }
    }
 
@@ -1077,13 +1208,13 @@ Read in an OS2 RLE 24 compressed 24 bit image.
 ******************************************************************************/
 static Gb _ReadBmpRLE24(Gimgio * const img, Bmpio * const data)
 {
-   Gindex loopIndex,
-          rindex,
-          cindex,
-          row,
-          runIndex;
-   Gcount count;
-   Gn1    byte[256 * 3]; 
+   Gindex     loopIndex,
+              rindex,
+              cindex,
+              row,
+              runIndex;
+   Gcount     count;
+   Gn1 const *byte;
 
    genter;
 
@@ -1099,17 +1230,25 @@ static Gb _ReadBmpRLE24(Gimgio * const img, Bmpio * const data)
 
    loopCount(loopIndex)
    {
+      // Past the last row, nothing more can be stored.
+      breakIf(rindex >= img->height);
+
       // Read RLE Header and follow byte.
-      gfileGet(img->file, 1, byte);
+      byte = _ReadGet(img, data, 1);
+      greturnFalseIf(!byte);
 
       // Repeat run
       if      (byte[0] > 0)
       {
          count = byte[0];
-         gfileGet(img->file, 3, byte);
+         byte  = _ReadGet(img, data, 3);
+         greturnFalseIf(!byte);
 
          for (runIndex = 0; runIndex < count; runIndex++)
          {
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+
             data->row[row][cindex * 3 + 0] = byte[2];
             data->row[row][cindex * 3 + 1] = byte[1];
             data->row[row][cindex * 3 + 2] = byte[0];
@@ -1119,16 +1258,21 @@ static Gb _ReadBmpRLE24(Gimgio * const img, Bmpio * const data)
          continue;
       }
 
-      gfileGet(img->file, 1, byte);
+      byte = _ReadGet(img, data, 1);
+      greturnFalseIf(!byte);
 
       // Raw run
       if      (byte[0] >= 3)
       {
          count = byte[0];
-         gfileGet(img->file, count * 3, byte);
+         byte  = _ReadGet(img, data, count * 3);
+         greturnFalseIf(!byte);
 
          for (runIndex = 0; runIndex < count; runIndex++)
          {
+            // Runs don't wrap.  What goes past the end of the row is dropped.
+            breakIf(cindex >= img->width);
+
             data->row[row][cindex * 3 + 0] = byte[runIndex * 3 + 2];
             data->row[row][cindex * 3 + 1] = byte[runIndex * 3 + 1];
             data->row[row][cindex * 3 + 2] = byte[runIndex * 3 + 0];
@@ -1156,9 +1300,20 @@ static Gb _ReadBmpRLE24(Gimgio * const img, Bmpio * const data)
       // Move the current pixel.
       else if (byte[0] == 2)
       {
-         gfileGet(img->file, 2, byte);
+         byte = _ReadGet(img, data, 2);
+         greturnFalseIf(!byte);
          cindex += byte[0];
          rindex += byte[1];
+
+         // A move off the side of the image is a broken file.
+         greturnFalseIf(cindex > img->width);
+
+         breakIf(rindex >= img->height);
+         row = rindex;
+         if (data->iisBottomUp)
+         {
+            row = img->height - 1 - rindex;
+         }
       }
    }
 
@@ -1185,11 +1340,13 @@ static Gb _ReadBmpBitField16(Gimgio * const img, Bmpio * const data)
         boff,
         aoff;
    Gn2 *pixel;
+   Gn1 const 
+       *buffer;
 
    genter;
 
    widthWithPad = (Gn4) _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn2, widthWithPad / 2);
+   pixel        = memioCreateTypeArray(img->memory, Gn2, widthWithPad / 2);
    greturnFalseIf(!pixel);
 
    // Get the manipulations.
@@ -1200,7 +1357,14 @@ static Gb _ReadBmpBitField16(Gimgio * const img, Bmpio * const data)
 
    for (rindex = 0; rindex < img->height; rindex++)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      // Copied out so the wide reads below are aligned.
+      buffer = _ReadGet(img, data, (Gcount) widthWithPad);
+      if (!buffer)
+      {
+         memioDestroyBuffer(img->memory, pixel);
+         greturn gbFALSE;
+      }
+      memcpy(pixel, buffer, widthWithPad);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -1217,7 +1381,7 @@ static Gb _ReadBmpBitField16(Gimgio * const img, Bmpio * const data)
       }
    }
 
-   gmemDestroy(pixel);
+   memioDestroyBuffer(img->memory, pixel);
 
    greturn gbTRUE;
 }
@@ -1242,11 +1406,13 @@ static Gb _ReadBmpBitField32(Gimgio * const img, Bmpio * const data)
         boff,
         aoff,
        *pixel;
+   Gn1 const 
+       *buffer;
 
    genter;
 
    widthWithPad = (Gn4) _GetWidthPadded(img, data);
-   pixel        = gmemCreateTypeArray(Gn4, widthWithPad / 4);
+   pixel        = memioCreateTypeArray(img->memory, Gn4, widthWithPad / 4);
    greturnFalseIf(!pixel);
 
    // Get the manipulations.
@@ -1257,7 +1423,14 @@ static Gb _ReadBmpBitField32(Gimgio * const img, Bmpio * const data)
 
    for (rindex = 0; rindex < img->height; rindex++)
    {
-      gfileGet(img->file, widthWithPad, pixel);
+      // Copied out so the wide reads below are aligned.
+      buffer = _ReadGet(img, data, (Gcount) widthWithPad);
+      if (!buffer)
+      {
+         memioDestroyBuffer(img->memory, pixel);
+         greturn gbFALSE;
+      }
+      memcpy(pixel, buffer, widthWithPad);
 
       row = rindex;
       if (data->iisBottomUp)
@@ -1274,7 +1447,7 @@ static Gb _ReadBmpBitField32(Gimgio * const img, Bmpio * const data)
       }
    }
 
-   gmemDestroy(pixel);
+   memioDestroyBuffer(img->memory, pixel);
 
    greturn gbTRUE;
 }
@@ -1317,6 +1490,42 @@ static void _ReadBmpBitFieldInfo(Bmpio * const data, Gn4 const mask, Gn4 * const
    greturn;
 }
 
+/******************************************************************************
+func: _ReadGet
+
+Get the next count bytes of the pixel data.  The bytes are read ahead in 
+large blocks so this is usually just a pointer bump.  NULL when the file runs
+out.
+******************************************************************************/
+static Gn1 const *_ReadGet(Gimgio * const img, Bmpio * const data, Gcount const count)
+{
+   Gcount     rest;
+   Gn1 const *result;
+
+   genter;
+
+   // Not enough in the buffer.  Move what is left to the front and fill up 
+   // the rest.
+   if (data->readCount - data->readIndex < count)
+   {
+      greturnNullIf(count > data->readBufferSize);
+
+      rest = data->readCount - data->readIndex;
+      memmove(data->readBuffer, &data->readBuffer[data->readIndex], rest);
+
+      data->readIndex = 0;
+      data->readCount = rest + 
+         streamioGet(img->stream, data->readBufferSize - rest, &data->readBuffer[rest]);
+
+      greturnNullIf(data->readCount < count);
+   }
+
+   result           = &data->readBuffer[data->readIndex];
+   data->readIndex += count;
+
+   greturn result;
+}
+
 /******************************************************************************
 func: _ReadMask
 
@@ -1328,9 +1537,10 @@ static Gb _ReadMask(Gimgio * const img, Bmpio * const data)
 
    img;
 
+   // Only bit field and v4 files have masks.
    if (data->iversion != bmpVersion4)
    {
-      greturnFalseIf(data->icompression != bmpCompressionBITFIELD);
+      greturnTrueIf(data->icompression != bmpCompressionBITFIELD);
    }
 
    headerGetN4(data, data->rmask);
@@ -1352,8 +1562,7 @@ Read in the palette.
 ******************************************************************************/
 static Gb _ReadPalette(Gimgio * const img, Bmpio * const data)
 {
-   Gn4 index,
-       size;
+   Gn4 index;
 
    genter;
 
@@ -1361,30 +1570,22 @@ static Gb _ReadPalette(Gimgio * const img, Bmpio * const data)
 
    greturnTrueIf(!data->paletteCount);
 
-   data->palette = gmemCreateTypeArray(Gn1, data->paletteCount * 4);
+   data->palette = memioCreateTypeArray(img->memory, Gn1, data->paletteCount * 4);
    greturnFalseIf(!data->palette);
 
-   if (data->iversion == bmpVersion2 ||
-       data->iversion == bmpVersion2_OS2)
+   forCount(index, data->paletteCount)
    {
-      size = 3;
-   }
-   else
-   {
-      forCount(index, data->paletteCount)
-      {
-         // BGR order.  Read in as RGB.
-         headerGetN1(data, data->palette[index * 4 + 2]);
-         headerGetN1(data, data->palette[index * 4 + 1]);
-         headerGetN1(data, data->palette[index * 4 + 0]);
+      // BGR order.  Read in as RGB.
+      headerGetN1(data, data->palette[index * 4 + 2]);
+      headerGetN1(data, data->palette[index * 4 + 1]);
+      headerGetN1(data, data->palette[index * 4 + 0]);
 
-         data->palette[index * 4 + 3] = 0xff;
+      data->palette[index * 4 + 3] = 0xff;
 
-         if (data->iversion != bmpVersion2)
-         {
-            // skipped
-            headerSKIP(data, 1);
-         }
+      // v2 entries are 3 bytes, the rest 4.
+      if (data->iversion != bmpVersion2)
+      {
+         headerSKIP(data, 1);
       }
    }
 
@@ -1398,10 +1599,10 @@ Write out the bmp file.
 ******************************************************************************/
 static Gb _WriteBmp(Gimgio * const img, Bmpio * const data) 
 {
-   Gi4   row,
-         col,
-         widthWithPad;
-   Gn1  *pixel;
+   Gi4         row,
+               widthWithPad;
+   Gn1        *pixel;
+   SimdioFunc  swapRB;
 
    genter;
 
@@ -1409,7 +1610,7 @@ static Gb _WriteBmp(Gimgio * const img, Bmpio * const data)
    data->ibpp   = 24;
    widthWithPad = _GetWidthPadded(img, data);
 
-   pixel = gmemCreateTypeArray(Gn1, widthWithPad);
+   pixel = memioCreateTypeArray(img->memory, Gn1, widthWithPad);
    greturnFalseIf(!pixel);
 
    // Write out a plain old raw 24 bit image.
@@ -1442,27 +1643,22 @@ static Gb _WriteBmp(Gimgio * const img, Bmpio * const data)
    headerSetN4(data, 0);
 
    // Write out the headers
-   gfileSet(
-      img->file, 
+   streamioSet(
+      img->stream, 
       14 + 40,
-      data->header,
-      NULL);
+      data->header);
 
    // Write out the image data.
+   swapRB = simdioGetFunc(simdioKernelSWAP_RB);
    forCountDown(row, img->height)
    {
-      forCount(col, img->width)
-      {
-         // bgr
-         pixel[col * 3 + 0] = data->row[row][col * 3 + 2];
-         pixel[col * 3 + 1] = data->row[row][col * 3 + 1];
-         pixel[col * 3 + 2] = data->row[row][col * 3 + 0];
-      }
-      gfileSet(img->file, widthWithPad, pixel, NULL);
+      // bgr
+      swapRB(img->width, data->row[row], pixel);
+      streamioSet(img->stream, widthWithPad, pixel);
    }
 
    // Clean up
-   gmemDestroy(pixel);
+   memioDestroyBuffer(img->memory, pixel);
 
    greturn gbTRUE;
 }
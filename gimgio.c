@@ -25,16 +25,145 @@ include:
 local: 
 type:
 ******************************************************************************/
+#define typeCHANNEL  (gimgioTypeBLACK | gimgioTypeRGB | gimgioTypeALPHA)
+#define typeSIZE     (gimgioTypeBIT | gimgioTypeNATURAL | gimgioTypeREAL)
+
+// A row kernel.  count is in pixels or in channel values depending on the 
+// kernel.  See _ConvertGetFunc.
+typedef void (*GimgioConvertFunc)(Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+// Shared by the threads of one gimgioBatchLoad.
+typedef struct
+{
+   TaskioLock               *lock;
+   TaskioSignal             *signal;
+   Gpath const * const      *filenameList;
+   GimgioType                type;
+   GimgioBatchResult        *resultList;
+   Gsize                     memoryMax;
+   Gsize                     memoryInUse;
+} GimgioBatch;
+
+// Shared by the stages of one gimgioTranscode.  Row r of the image is in 
+// slot r % rowCount.  decoded, converted and encoded count the rows each 
+// stage is done with.  With no conversion rowOut is rowIn.
+typedef struct
+{
+   TaskioLock               *lock;
+   TaskioSignal             *signal;
+   Gimgio                   *src;
+   Gimgio                   *dst;
+   Gcount                    rowCount;
+   Gsize                     rowInSize;
+   Gsize                     rowOutSize;
+   Gn1                      *rowIn;
+   Gn1                      *rowOut;
+   Gindex                    decoded;
+   Gindex                    converted;
+   Gindex                    encoded;
+   Gb                        isConverting;
+   Gb                        isError;
+} GimgioTranscode;
 
 /******************************************************************************
 prototype:
 ******************************************************************************/
-static Gb _Start(Gimgio * const img);
+static void              _BatchLoad(                  void * const data, Gindex const index);
+
+static void              _ConvertBlackAlphaN1ToRgbaN1(Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void              _ConvertBlackN1ToRgbaN1(     Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static GimgioConvertFunc _ConvertGetFunc(             GimgioType const inType, GimgioType const outType, Gi4 * const countScale);
+static Gi4               _ConvertGetChannelCount(     GimgioType const type);
+static void              _ConvertN1ToR4(              Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+static GimgioFormat      _GetFormatFromStream(        Streamio * const stream);
+
+static Gimgio           *_OpenStream(                 Streamio * const stream, GimgioOpenMode const mode, GimgioFormat const format);
+
+static Gb                _Start(                      Gimgio * const img);
+
+static void              _TranscodeConvert(           void * const data);
+static void              _TranscodeDecode(            void * const data);
+static void              _TranscodeEncode(            GimgioTranscode * const tc);
+static void              _TranscodeSetIndex(          GimgioTranscode * const tc, Gindex * const index, Gindex const value, Gb const isOk);
+static Gb                _TranscodeWait(              GimgioTranscode * const tc, Gindex const * const index, Gindex const value);
 
 /******************************************************************************
 global:
 function: 
 ******************************************************************************/
+/******************************************************************************
+func: gimgioBatchLoad
+
+Load many files at once, spread over threadCount threads.  0 for all cores.
+Each file is loaded whole by one thread, as gimgioLoad would, so the threads
+only share the list of what is left to do.  A thread takes the next file
+when it is done with the last so a few big files don't hold up the rest.
+
+memoryMax limits the pixel bytes of the images being decoded at the same 
+time.  A thread waits before it starts on an image that would go over.  An
+image bigger than memoryMax on its own still loads, just on its own.  0 for
+no limit.
+
+resultList has count entries.  Returns gbTRUE when every file loaded.  The
+ones that didn't have isLoaded gbFALSE and no pixel.
+******************************************************************************/
+gimgioAPI Gb gimgioBatchLoad(Gpath const * const * const filenameList, Gcount const count, 
+   GimgioType const type, GimgioBatchResult * const resultList, Gcount const threadCount, 
+   Gsize const memoryMax)
+{
+   genter;
+
+   GimgioBatch batch;
+   Gindex      index;
+   Gb          result;
+
+   greturnFalseIf(
+      !filenameList ||
+      !resultList   ||
+      count < 0     ||
+      type == gimgioTypeNONE);
+
+   gmemClear(resultList, gsizeof(GimgioBatchResult) * count);
+
+   batch.lock         = taskioLockCreate();
+   batch.signal       = taskioSignalCreate();
+   batch.filenameList = filenameList;
+   batch.type         = type;
+   batch.resultList   = resultList;
+   batch.memoryMax    = memoryMax;
+   batch.memoryInUse  = 0;
+
+   result = gbFALSE;
+
+   breakScope
+   {
+      breakIf(
+         !batch.lock ||
+         !batch.signal);
+
+      taskioRun(
+         threadCount ? threadCount : taskioGetCoreCount(), 
+         count, 
+         _BatchLoad, 
+         &batch);
+
+      result = gbTRUE;
+      forCount(index, count)
+      {
+         if (!resultList[index].isLoaded)
+         {
+            result = gbFALSE;
+         }
+      }
+   }
+
+   taskioSignalDestroy(batch.signal);
+   taskioLockDestroy(  batch.lock);
+
+   greturn result;
+}
+
 /******************************************************************************
 func: gimgioClose
 
@@ -59,10 +188,13 @@ gimgioAPI void gimgioClose(Gimgio * const img)
       TIFFClose(img->tiffFile);
    }
 #endif
-   gfileClose(img->file);
+   streamioDestroy(img->stream);
 
    gsDestroy(img->fileName);
 
+   // Arena or not, the codec is done with it.
+   memioDestroy(img->memory);
+
    gmemDestroy(img);
 
    greturn;
@@ -71,12 +203,30 @@ gimgioAPI void gimgioClose(Gimgio * const img)
 /******************************************************************************
 func: gimgioConvert
 
-Convert a row from one format to another.
+Convert a row from one format to another.  The type pair is resolved once 
+for the whole row.  Common pairs have their own tight loop, everything else
+falls back to the per pixel Get/Set path.
 ******************************************************************************/
-gimgioAPI void gimgioConvert(Gi4 const width, GimgioType const inType, void * const in,
+gimgioAPI void gimgioConvert(Gi4 const width, GimgioType const inType, void const * const in,
    GimgioType const outType, void * const out)
 {
-   Gi4 index;
+   Gi4               index,
+                     countScale;
+   GimgioConvertFunc func;
+
+   // Same layout, nothing to convert.
+   if (inType == outType)
+   {
+      memcpy(out, in, (size_t) gimgioGetPixelSize(inType, width));
+      return;
+   }
+
+   func = _ConvertGetFunc(inType, outType, &countScale);
+   if (func)
+   {
+      func(width * countScale, (Gn1 const *) in, (Gn1 *) out);
+      return;
+   }
 
    if (inType & gimgioTypeREAL)
    {
@@ -84,7 +234,7 @@ gimgioAPI void gimgioConvert(Gi4 const width, GimgioType const inType, void * co
 
       forCount(index, width)
       {
-         gimgioGetPixelAtR(inType,  index, in,  &r, &g, &b, &a);
+         gimgioGetPixelAtR(inType,  index, (void *) in,  &r, &g, &b, &a);
          gimgioSetPixelAtR(outType, index, out, r,  g,  b,  a);
       }
    }
@@ -94,7 +244,7 @@ gimgioAPI void gimgioConvert(Gi4 const width, GimgioType const inType, void * co
 
       forCount(index, width)
       {
-         gimgioGetPixelAtN(inType,  index, in,  &r, &g, &b, &a);
+         gimgioGetPixelAtN(inType,  index, (void *) in,  &r, &g, &b, &a);
          gimgioSetPixelAtN(outType, index, out, r,  g,  b,  a);
       }
    }
@@ -114,6 +264,20 @@ gimgioAPI Gr gimgioGetCompression(Gimgio const * const img)
    greturn (Gr4) (img->compression * 100.);
 }
 
+/******************************************************************************
+func: gimgioGetDecodeScale
+
+Get the reduction the image is read at.  1 for full size.
+******************************************************************************/
+gimgioAPI Gcount gimgioGetDecodeScale(Gimgio const * const img)
+{
+   genter;
+
+   greturnIf(!img, 0);
+
+   greturn img->decodeScale;
+}
+
 /******************************************************************************
 func: gimgioGetFormat
 
@@ -128,6 +292,113 @@ gimgioAPI GimgioFormat gimgioGetFormat(Gimgio const * const img)
    greturn img->format;
 }
 
+/******************************************************************************
+func: gimgioGetFormatFromContent
+
+Get the format from the first bytes of the file.  Only the first 16 bytes are
+looked at.  Nothing is allocated.
+******************************************************************************/
+gimgioAPI GimgioFormat gimgioGetFormatFromContent(Gcount const count, Gn1 const * const buffer)
+{
+   genter;
+
+   greturnIf(!buffer, gimgioFormatNONE);
+
+   // 89 'P' 'N' 'G' \r \n 1A \n
+   if      (count >= 8         &&
+            buffer[0] == 0x89  &&
+            buffer[1] == 'P'   &&
+            buffer[2] == 'N'   &&
+            buffer[3] == 'G'   &&
+            buffer[4] == 0x0D  &&
+            buffer[5] == 0x0A  &&
+            buffer[6] == 0x1A  &&
+            buffer[7] == 0x0A)
+   {
+      greturn gimgioFormatPNG;
+   }
+   // SOI marker followed by the start of another marker.
+   else if (count >= 3         &&
+            buffer[0] == 0xFF  &&
+            buffer[1] == 0xD8  &&
+            buffer[2] == 0xFF)
+   {
+      greturn gimgioFormatJPG;
+   }
+   else if (count >= 4         &&
+            buffer[0] == 'G'   &&
+            buffer[1] == 'R'   &&
+            buffer[2] == 'A'   &&
+            buffer[3] == 'W')
+   {
+      greturn gimgioFormatGRAW;
+   }
+   else if (count >= 2         &&
+            buffer[0] == 'B'   &&
+            buffer[1] == 'M')
+   {
+      greturn gimgioFormatBMP;
+   }
+   // GIF87a or GIF89a
+   else if (count >= 6         &&
+            buffer[0] == 'G'   &&
+            buffer[1] == 'I'   &&
+            buffer[2] == 'F'   &&
+            buffer[3] == '8'   &&
+            (buffer[4] == '7' || buffer[4] == '9') &&
+            buffer[5] == 'a')
+   {
+      greturn gimgioFormatGIF;
+   }
+   // Intel or Motorola byte order followed by 42.
+   else if (count >= 4         &&
+            ((buffer[0] == 'I' && buffer[1] == 'I' && buffer[2] == 42 && buffer[3] == 0) ||
+             (buffer[0] == 'M' && buffer[1] == 'M' && buffer[2] == 0  && buffer[3] == 42)))
+   {
+      greturn gimgioFormatTIFF;
+   }
+   // P1 to P6 followed by white space.
+   else if (count >= 3         &&
+            buffer[0] == 'P'   &&
+            buffer[1] >= '1'   &&
+            buffer[1] <= '6'   &&
+            (buffer[2] == ' '  || buffer[2] == '\t' || buffer[2] == '\r' || buffer[2] == '\n'))
+   {
+      greturn gimgioFormatPPM;
+   }
+
+   greturn gimgioFormatNONE;
+}
+
+/******************************************************************************
+func: gimgioGetFormatFromFile
+
+Get the format from the first bytes of the file.  The file position is left
+where it was.
+******************************************************************************/
+gimgioAPI GimgioFormat gimgioGetFormatFromFile(Gfile * const file)
+{
+   genter;
+
+   Gn1          buffer[16];
+   Gcount       count;
+   GfileIndex   position;
+   GimgioFormat result;
+
+   greturnIf(!file, gimgioFormatNONE);
+
+   position = gfileGetPosition(file);
+
+   count  = gfileGet(file, 16, buffer);
+   result = gimgioGetFormatFromContent(count, buffer);
+
+   greturnIf(
+      !gfileSetPosition(file, gpositionSTART, position), 
+      gimgioFormatNONE);
+
+   greturn result;
+}
+
 /******************************************************************************
 func: gimgioGetFormatFromName
 
@@ -220,7 +491,7 @@ gimgioAPI Gi4 gimgioGetImageCount(Gimgio const * const img)
 {
    genter;
 
-   greturnIf(img, 0);
+   greturnIf(!img, 0);
 
    greturn img->imageCount;
 }
@@ -262,21 +533,44 @@ gimgioAPI Gb gimgioGetPixelRow(Gimgio * const img, void * const pixel)
 /******************************************************************************
 func: gimgioGetPixelRowAll
 
-Do the heavy lifting on loading the image.
+Do the heavy lifting on loading the image.  Rows are packed one after the 
+other.
 ******************************************************************************/
 gimgioAPI Gb gimgioGetPixelRowAll(Gimgio * const img, Gn1 * const pixel)
 {
-   Gi4 row;
+   genter;
 
-   // Read in the entire image.
-   forCount(row, img->height)
-   {
-      gimgioSetRow(img, row);
+   greturnFalseIf(!img);
 
-      gimgioGetPixelRow(img, &(pixel[gimgioGetPixelSize(img->typePixel, img->width) * row]));
-   }
+   greturn gimgioLoadInto(
+      img, 
+      pixel, 
+      gimgioGetPixelSize(img->typePixel, img->width), 
+      img->typePixel);
+}
 
-   return gbTRUE;
+/******************************************************************************
+func: gimgioGetPixelRowPointer
+
+Get a pointer to the current row without copying it.  Only when the pixel 
+type is the file type and the format supports it, currently GRAW.  The 
+pointer is valid until the next call on img.  NULL otherwise, use 
+gimgioGetPixelRow instead.
+******************************************************************************/
+gimgioAPI void const *gimgioGetPixelRowPointer(Gimgio * const img)
+{
+   genter;
+
+   void const *result;
+
+   greturnNullIf(
+      !img                               ||
+      !img->GetPixelRowPointer           ||
+      img->typePixel != img->typeFile);
+
+   result = img->GetPixelRowPointer(img);
+
+   greturn result;
 }
 
 /******************************************************************************
@@ -434,7 +728,7 @@ gimgioAPI void gimgioGetPixelAtN(GimgioType const type, Gi4 const index, void *
       break;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2:
-      n2 = (Gn2 *) &(buffer[index * 2]);
+      n2 = (Gn2 *) &(buffer[index * 4]);
       *r    = 
          *g = 
          *b = N2ToN4(n2[0]);
@@ -442,7 +736,7 @@ gimgioAPI void gimgioGetPixelAtN(GimgioType const type, Gi4 const index, void *
       break;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN4:
-      n4 = (Gn4 *) &(buffer[index * 4]);
+      n4 = (Gn4 *) &(buffer[index * 8]);
       *r    = 
          *g = 
          *b = n4[0];
@@ -450,7 +744,7 @@ gimgioAPI void gimgioGetPixelAtN(GimgioType const type, Gi4 const index, void *
       break;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR4:
-      r4 = (Gr4 *) &(buffer[index * 4]);
+      r4 = (Gr4 *) &(buffer[index * 8]);
       *r    = 
          *g = 
          *b = RToN4(r4[0]);
@@ -458,7 +752,7 @@ gimgioAPI void gimgioGetPixelAtN(GimgioType const type, Gi4 const index, void *
       break;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR8:
-      r8 = (Gr8 *) &(buffer[index * 8]);
+      r8 = (Gr8 *) &(buffer[index * 16]);
       *r    = 
          *g = 
          *b = RToN4(r8[0]);
@@ -626,6 +920,20 @@ gimgioAPI Gi4 gimgioGetRow(Gimgio const * const img)
    greturn img->row;
 }
 
+/******************************************************************************
+func: gimgioGetThreadCount
+
+Get the number of threads a codec may use.  0 means all cores.
+******************************************************************************/
+gimgioAPI Gcount gimgioGetThreadCount(Gimgio const * const img)
+{
+   genter;
+
+   greturnIf(!img, 1);
+
+   greturn img->threadCount;
+}
+
 /******************************************************************************
 func: gimgioGetTypeFile
 
@@ -637,7 +945,7 @@ gimgioAPI GimgioType gimgioGetTypeFile(Gimgio const * const img)
    
    greturnIf(!img, gimgioTypeNONE);
 
-   greturn img->format;
+   greturn img->typeFile;
 }
 
 /******************************************************************************
@@ -707,7 +1015,7 @@ gimgioAPI Gb gimgioLoad(Gpath const * const filename, GimgioType const type,
    breakScope
    {
       // Open the image file.
-      imgio = gimgioOpen(filename, gimgioOpenREAD, gimgioGetFormatFromName(filename));
+      imgio = gimgioOpen(filename, gimgioOpenREAD, gimgioFormatNONE);
       breakIf(!imgio);
 
       // Get the image dimensions.
@@ -722,7 +1030,11 @@ gimgioAPI Gb gimgioLoad(Gpath const * const filename, GimgioType const type,
       breakIf(!pixelBuffer);
 
       // Populate the pixel buffer
-      breakIf(!gimgioGetPixelRowAll(imgio, pixelBuffer));
+      if (!gimgioLoadInto(imgio, pixelBuffer, pixelSize, type))
+      {
+         gmemDestroy(pixelBuffer);
+         break;
+      }
 
       *pixel = pixelBuffer;
 
@@ -735,10 +1047,51 @@ gimgioAPI Gb gimgioLoad(Gpath const * const filename, GimgioType const type,
    greturn result;
 }
 
+/******************************************************************************
+func: gimgioLoadInto
+
+Read the entire image into a buffer provided by the caller.  rowStride is the
+byte count from the start of one row to the start of the next and can be 
+larger than a row of pixels so the image can land in the middle of a larger
+buffer.  When type matches the file type the codecs that can will decode 
+directly into the buffer.
+******************************************************************************/
+gimgioAPI Gb gimgioLoadInto(Gimgio * const img, void * const buffer, Gsize const rowStride,
+   GimgioType const type)
+{
+   genter;
+
+   Gindex row;
+   Gn1   *pixel;
+
+   greturnFalseIf(
+      !img                                           ||
+      !buffer                                        ||
+      img->mode != gimgioOpenREAD                    ||
+      type      == gimgioTypeNONE                    ||
+      rowStride <  gimgioGetPixelSize(type, img->width));
+
+   img->typePixel = type;
+
+   pixel = (Gn1 *) buffer;
+   forCount(row, img->height)
+   {
+      img->row = row;
+
+      greturnFalseIf(!img->GetPixelRow(img, pixel));
+
+      pixel += rowStride;
+   }
+
+   greturn gbTRUE;
+}
+
 /******************************************************************************
 func: gimgioOpen_
 
-Open an image file for reading, writing or appending.
+Open an image file for reading, writing or appending.  When reading only the
+header is read here.  Pixels are decoded when rows are asked for.  When 
+reading, format can be gimgioFormatNONE to detect it from the file content.
 ******************************************************************************/
 gimgioAPI Gimgio *gimgioOpen_(Gpath const * const fileName, GimgioOpenMode const mode, 
    GimgioFormat const format)
@@ -753,21 +1106,43 @@ gimgioAPI Gimgio *gimgioOpen_(Gpath const * const fileName, GimgioOpenMode const
    greturnNullIf(
       !fileName                ||
       mode   == gimgioOpenNONE ||
-      format == gimgioFormatNONE);
+      (mode   == gimgioOpenWRITE &&
+       format == gimgioFormatNONE));
 
    img = gmemCreateType(Gimgio);
    greturnNullIf(!img);
 
    loop
    {
-      img->mode     = mode;
-      img->format   = format;
-      img->fileName = gsCreateFrom(fileName);
+      img->mode        = mode;
+      img->format      = format;
+      img->fileName    = gsCreateFrom(fileName);
+      img->compression = gimgioCompressionDEFAULT / 100.;
+      img->threadCount = 1;
+      img->decodeScale = 1;
+
+      img->memory      = memioCreate();
+      breakIf(!img->memory);
+
+      // No format given.  Find out from the content, failing that from the
+      // extension.
+      if (img->format == gimgioFormatNONE)
+      {
+         img->stream = streamioCreateFile(fileName, gimgioOpenREAD);
+         breakIf(!img->stream);
+
+         img->format = _GetFormatFromStream(img->stream);
+         if (img->format == gimgioFormatNONE)
+         {
+            img->format = gimgioGetFormatFromName(fileName);
+         }
+         breakIf(img->format == gimgioFormatNONE);
+      }
 
       if (mode == gimgioOpenREAD)
       {
 #if defined(GIMGIO_TIFF)
-         if      (format == gimgioFormatTIFF)
+         if      (img->format == gimgioFormatTIFF)
          {
             ctemp = gsCreateA(fileName);
             img->tiffFile = TIFFOpen((const char *) ctemp, "r");
@@ -775,13 +1150,13 @@ gimgioAPI Gimgio *gimgioOpen_(Gpath const * const fileName, GimgioOpenMode const
          }
          else 
 #endif
-         if       (format == gimgioFormatGIF)
+         if       (img->format == gimgioFormatGIF)
          {
             // No open of the file.  That is left to the library.
          }
-         else
+         else if (!img->stream)
          {
-            img->file = gfileOpen(fileName, gfileOpenModeREAD_ONLY);
+            img->stream = streamioCreateFile(fileName, gimgioOpenREAD);
          }
       }
       else 
@@ -801,24 +1176,24 @@ gimgioAPI Gimgio *gimgioOpen_(Gpath const * const fileName, GimgioOpenMode const
          }
          else
          {
-            img->file = gfileOpen(fileName, gfileOpenModeREAD_WRITE);
+            img->stream = streamioCreateFile(fileName, gimgioOpenWRITE);
          }
       }
 
 #if defined(GIMGIO_TIFF)
-      if      (format == gimgioFormatTIFF) 
+      if      (img->format == gimgioFormatTIFF) 
       {
          breakIf(!img->tiffFile);
       }
       else
 #endif
-      if (format == gimgioFormatGIF)
+      if (img->format == gimgioFormatGIF)
       {
          // nothing to do.
       }
       else
       {
-         breakIf(!img->file);
+         breakIf(!img->stream);
       }
 
       // Read in the basic information.
@@ -840,124 +1215,421 @@ gimgioAPI Gimgio *gimgioOpen_(Gpath const * const fileName, GimgioOpenMode const
       TIFFClose(img->tiffFile);
    }
 #endif
-   gfileClose(img->file);
+   streamioDestroy(img->stream);
+   gsDestroy(img->fileName);
+   memioDestroy(img->memory);
    gmemDestroy(img);
 
    greturn NULL;
 }
 
 /******************************************************************************
-func: gimgioSetCompression
+func: gimgioOpenMemory_
 
-Set the compression amount of the file.  
-percent ranges from 0 - 100.  100 means full compression.
+Open an image already in memory for reading.  The buffer is not copied so 
+it has to stay until gimgioClose.  format can be gimgioFormatNONE to detect
+it from the content.  GIF and TIFF need a file.
 ******************************************************************************/
-gimgioAPI Gb gimgioSetCompression(Gimgio * const img, Gr const percent)
+gimgioAPI Gimgio *gimgioOpenMemory_(void const * const buffer, Gsize const count, 
+   GimgioFormat const format)
 {
    genter;
 
-   greturnFalseIf(
-      !img || 
-      img->mode == gimgioOpenREAD);
+   Streamio *stream;
 
-   // 0-1 internally
-   img->compression = (Gr4) (percent / 100.);
+   stream = streamioCreateMemory(buffer, count);
+   greturnNullIf(!stream);
 
-   greturn gbTRUE;
+   greturn _OpenStream(stream, gimgioOpenREAD, format);
 }
 
 /******************************************************************************
-func: gimgioSetHeight
+func: gimgioOpenStream_
 
-Set the height of the image.  Set the page first before setting the
-height in a multi page image format.
+Open an image on the caller's own stream, say a socket or a member of an 
+archive.  When reading, format can be gimgioFormatNONE to detect it from the
+content.  The stream has to stay until gimgioClose.  Writing GRAW needs 
+SetPosition.  GIF and TIFF need a file.
 ******************************************************************************/
-gimgioAPI Gb gimgioSetHeight(Gimgio * const img, Gi4 const height)
+gimgioAPI Gimgio *gimgioOpenStream_(GimgioStream const * const streamCaller, 
+   GimgioOpenMode const mode, GimgioFormat const format)
 {
    genter;
 
-   // reading is dictated by the file.
-   greturnFalseIf(
-      !img || 
-      img->mode == gimgioOpenREAD);
+   Streamio *stream;
 
-   img->height = height;
+   greturnNullIf(
+      !streamCaller                                  ||
+      (mode == gimgioOpenREAD  && !streamCaller->Get) ||
+      (mode == gimgioOpenWRITE && !streamCaller->Set));
 
-   greturn gbTRUE;
+   stream = streamioCreateStream(streamCaller);
+   greturnNullIf(!stream);
+
+   greturn _OpenStream(stream, mode, format);
 }
 
 /******************************************************************************
-func: gimgioSetImageIndex
+func: gimgioProbe
 
-Set the image we want to read from the file.
+Get the basic information of an image without reading any pixels.  Only the
+header of the file is read.
 ******************************************************************************/
-gimgioAPI Gb gimgioSetImageIndex(Gimgio * const img, Gi4 const index)
+gimgioAPI Gb gimgioProbe(Gpath const * const filename, GimgioInfo * const info)
 {
    genter;
 
+   Gimgio *imgio;
+
    greturnFalseIf(
-      index >= img->imageCount ||
-      !img->SetImageIndex(img, index));
+      !filename ||
+      !info);
+
+   gmemClear(info, gsizeof(GimgioInfo));
+
+   // Opening for read only reads the header.  Pixels are read on the first
+   // gimgioGetPixelRow.
+   imgio = gimgioOpen(filename, gimgioOpenREAD, gimgioFormatNONE);
+   greturnFalseIf(!imgio);
+
+   info->format     = imgio->format;
+   info->typeFile   = imgio->typeFile;
+   info->imageCount = imgio->imageCount;
+   info->width      = imgio->width;
+   info->height     = imgio->height;
+
+   gimgioClose(imgio);
 
    greturn gbTRUE;
 }
 
 /******************************************************************************
-func: gimgioSetPixelRow
-
-Set the row to work on.
+func: gimgioReopen
+
+Read another file with a handle open for reading.  When the new file is in
+the same format the codec keeps its context and buffers, which saves most 
+of the set up when reading lots of small images.  With an arena allocator
+the codec is made again for every file so the arena can start over.  The 
+pixel type, thread count, compression and decode scale stay as they were.  
+If this fails the handle is only good for gimgioClose.
 ******************************************************************************/
-gimgioAPI Gb gimgioSetPixelRow(Gimgio * const img, void * const pixel)
+gimgioAPI Gb gimgioReopen(Gimgio * const img, Gpath const * const fileName)
 {
-   Gb result;
-   
    genter;
 
+   GimgioFormat  format;
+   Streamio     *stream;
+   Gb            isReset,
+                 result;
+
    greturnFalseIf(
-      !img                        ||
-      img->mode == gimgioOpenREAD ||
-      img->row  >= img->height);
+      !img      ||
+      !fileName ||
+      img->mode != gimgioOpenREAD);
 
-   result = img->SetPixelRow(img, pixel);
+   stream = streamioCreateFile(fileName, gimgioOpenREAD);
+   greturnFalseIf(!stream);
 
-   greturn result;
+   format = _GetFormatFromStream(stream);
+   if (format == gimgioFormatNONE)
+   {
+      format = gimgioGetFormatFromName(fileName);
+   }
+
+   // Stop the codec while its stream is still there.  A decode thread may
+   // be reading it.  An arena only frees all at once so with one the codec
+   // is made again, or what each file allocates would pile up.
+   isReset = (
+      format == img->format      &&
+      img->data                  &&
+      img->Reset                 &&
+      !memioIsArena(img->memory));
+
+   result = gbTRUE;
+   if (isReset)
+   {
+      result = img->Reset(img);
+   }
+   else
+   {
+      if (img->DestroyContent &&
+          img->data)
+      {
+         img->DestroyContent(img);
+      }
+
+      img->data               = NULL;
+      img->DestroyContent     = NULL;
+      img->GetPixelRow        = NULL;
+      img->GetPixelRowPointer = NULL;
+      img->ReadStart          = NULL;
+      img->Reset              = NULL;
+      img->SetDecodeScale     = NULL;
+      img->SetImageIndex      = NULL;
+      img->SetPixelRow        = NULL;
+      img->SetTypeFile        = NULL;
+   }
+
+   streamioDestroy(img->stream);
+   gsDestroy(img->fileName);
+
+   img->stream     = stream;
+   img->fileName   = gsCreateFrom(fileName);
+   img->imageCount = 0;
+   img->imageIndex = 0;
+   img->width      = 0;
+   img->height     = 0;
+   img->row        = 0;
+   img->typeFile   = gimgioTypeNONE;
+
+   greturnFalseIf(!result);
+
+   // These open the file themselves.  Only gimgioOpen handles them.
+   greturnFalseIf(
+      format == gimgioFormatNONE ||
+      format == gimgioFormatGIF  ||
+      format == gimgioFormatTIFF);
+
+   if (!isReset)
+   {
+      // Nothing of the old codec is kept.  Start the arena over.
+      memioDestroy(img->memory);
+      img->memory = memioCreate();
+      greturnFalseIf(!img->memory);
+
+      img->format = format;
+      greturnFalseIf(!_Start(img));
+   }
+
+   greturn img->ReadStart(img);
 }
 
 /******************************************************************************
-func: gimgioSetPixelAtN
+func: gimgioSetAllocator
 
-Set the pixel in the pixel buffer.
+Set where the codecs get their memory.  NULL goes back to gmem.  Only call 
+it when no images are open.  The Gimgio itself and the buffers handed to the
+caller, like gimgioLoad's, still come from gmem so the caller can free them
+the usual way.
 ******************************************************************************/
-gimgioAPI Gb gimgioSetPixelAtN(GimgioType const type, Gi4 const index, void * const pixel,
-   Gn4 const r, Gn4 const g, Gn4 const b, Gn4 const a)
+gimgioAPI void gimgioSetAllocator(GimgioAllocator const * const allocator)
 {
-   Gn1 *buffer;
-   Gn2 *n2;
-   Gn4 *n4;
-   Gr4 *r4;
-   Gr8 *r8;
+   genter;
 
-   buffer = (Gn1 *) pixel;
+   memioSetAllocator(allocator);
 
-   switch(type)
-   {
-   case gimgioTypeBLACK | gimgioTypeB1:
-      gbitSet(buffer[index / 8], index % 8, 1, N4ToB1(r));
-      return gbTRUE;
+   greturn;
+}
 
-   case gimgioTypeBLACK | gimgioTypeB2:
-      gbitSet(buffer[index / 4], (index % 4) * 2, 2, N4ToB2(r));
-      return gbTRUE;
+/******************************************************************************
+func: gimgioSetBufferSize
 
-   case gimgioTypeBLACK | gimgioTypeB4:
-      gbitSet(buffer[index / 2], (index % 2) * 4, 4, N4ToB4(r));
-      return gbTRUE;
+Set the size of the buffers the codecs read and write the file through.  
+gimgioBufferSIZE until set.  The buffers are pooled and reused by the next
+image so only call it when no images are open.  Files read in one go, from
+memory or mapped, don't need one.
+******************************************************************************/
+gimgioAPI void gimgioSetBufferSize(Gsize const size)
+{
+   genter;
 
-   case gimgioTypeBLACK | gimgioTypeN1:
-      buffer[index] = N4ToN1(r);
-      return gbTRUE;
+   streamioSetBufferSize(size);
 
-   case gimgioTypeBLACK | gimgioTypeN2:
+   greturn;
+}
+
+/******************************************************************************
+func: gimgioSetCompression
+
+Set the compression amount of the file.  
+percent ranges from 0 - 100.  100 means full compression.  See the
+gimgioCompression presets.  gimgioCompressionDEFAULT until set, except JPEG
+which writes at full quality until set.
+******************************************************************************/
+gimgioAPI Gb gimgioSetCompression(Gimgio * const img, Gr const percent)
+{
+   genter;
+
+   greturnFalseIf(
+      !img || 
+      img->mode == gimgioOpenREAD);
+
+   // 0-1 internally
+   img->compression      = (Gr4) (percent / 100.);
+   img->isCompressionSet = gbTRUE;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: gimgioSetDecodeScale
+
+Read the image at 1/scale of its size.  scale is 1, 2, 4 or 8.  Only JPEG 
+can do it, where the reduction happens in the DCT and most of the decode 
+work is skipped.  Set it after opening and before reading the first row.
+The width and height change to the reduced size.  It stays for the files 
+gimgioReopen reads after this one.
+******************************************************************************/
+gimgioAPI Gb gimgioSetDecodeScale(Gimgio * const img, Gcount const scale)
+{
+   genter;
+
+   Gcount scaleOld;
+
+   greturnFalseIf(
+      !img                        ||
+      img->mode != gimgioOpenREAD ||
+      (scale != 1 && scale != 2 && 
+       scale != 4 && scale != 8));
+
+   greturnTrueIf(scale == img->decodeScale);
+   greturnFalseIf(!img->SetDecodeScale);
+
+   scaleOld         = img->decodeScale;
+   img->decodeScale = scale;
+   if (!img->SetDecodeScale(img))
+   {
+      img->decodeScale = scaleOld;
+      greturn gbFALSE;
+   }
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: gimgioSetDecodeSizeMax
+
+Read the image at the biggest reduction gimgioSetDecodeScale allows that 
+still keeps the longer side at least size.  For when the image is going to 
+be shrunk to size anyway, like a thumbnail.  Formats that can't reduce stay
+at full size, which isn't a failure.
+******************************************************************************/
+gimgioAPI Gb gimgioSetDecodeSizeMax(Gimgio * const img, Gcount const size)
+{
+   genter;
+
+   Gcount sizeFull,
+          scale;
+
+   greturnFalseIf(
+      !img                        ||
+      img->mode != gimgioOpenREAD ||
+      size <= 0);
+
+   greturnTrueIf(!img->SetDecodeScale);
+
+   // Back to full size first to know what we are reducing.
+   greturnFalseIf(!gimgioSetDecodeScale(img, 1));
+
+   sizeFull = gMAX(img->width, img->height);
+   for (scale = 8; scale > 1; scale /= 2)
+   {
+      // Rounded up, as the codec does.
+      breakIf((sizeFull + scale - 1) / scale >= size);
+   }
+
+   greturn gimgioSetDecodeScale(img, scale);
+}
+
+/******************************************************************************
+func: gimgioSetHeight
+
+Set the height of the image.  Set the page first before setting the
+height in a multi page image format.
+******************************************************************************/
+gimgioAPI Gb gimgioSetHeight(Gimgio * const img, Gi4 const height)
+{
+   genter;
+
+   // reading is dictated by the file.
+   greturnFalseIf(
+      !img || 
+      img->mode == gimgioOpenREAD);
+
+   img->height = height;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: gimgioSetImageIndex
+
+Set the image we want to read from the file.  When writing, set the next
+image to write.  Only formats with multiple images, like GRAW, allow it.
+******************************************************************************/
+gimgioAPI Gb gimgioSetImageIndex(Gimgio * const img, Gi4 const index)
+{
+   genter;
+
+   greturnFalseIf(
+      !img      ||
+      index < 0 ||
+      (img->mode == gimgioOpenREAD && index >= img->imageCount) ||
+      (img->mode != gimgioOpenREAD && index >  img->imageCount) ||
+      !img->SetImageIndex(img, index));
+
+   img->imageIndex = index;
+   img->row        = 0;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: gimgioSetPixelRow
+
+Set the row to work on.
+******************************************************************************/
+gimgioAPI Gb gimgioSetPixelRow(Gimgio * const img, void * const pixel)
+{
+   Gb result;
+   
+   genter;
+
+   greturnFalseIf(
+      !img                        ||
+      img->mode == gimgioOpenREAD ||
+      img->row  >= img->height);
+
+   result = img->SetPixelRow(img, pixel);
+
+   greturn result;
+}
+
+/******************************************************************************
+func: gimgioSetPixelAtN
+
+Set the pixel in the pixel buffer.
+******************************************************************************/
+gimgioAPI Gb gimgioSetPixelAtN(GimgioType const type, Gi4 const index, void * const pixel,
+   Gn4 const r, Gn4 const g, Gn4 const b, Gn4 const a)
+{
+   Gn1 *buffer;
+   Gn2 *n2;
+   Gn4 *n4;
+   Gr4 *r4;
+   Gr8 *r8;
+
+   buffer = (Gn1 *) pixel;
+
+   switch(type)
+   {
+   case gimgioTypeBLACK | gimgioTypeB1:
+      gbitSet(buffer[index / 8], index % 8, 1, N4ToB1(r));
+      return gbTRUE;
+
+   case gimgioTypeBLACK | gimgioTypeB2:
+      gbitSet(buffer[index / 4], (index % 4) * 2, 2, N4ToB2(r));
+      return gbTRUE;
+
+   case gimgioTypeBLACK | gimgioTypeB4:
+      gbitSet(buffer[index / 2], (index % 2) * 4, 4, N4ToB4(r));
+      return gbTRUE;
+
+   case gimgioTypeBLACK | gimgioTypeN1:
+      buffer[index] = N4ToN1(r);
+      return gbTRUE;
+
+   case gimgioTypeBLACK | gimgioTypeN2:
       n2  = (Gn2 *) &(buffer[index * 2]);
       *n2 = N4ToN2(r);
       return gbTRUE;
@@ -1000,25 +1672,25 @@ gimgioAPI Gb gimgioSetPixelAtN(GimgioType const type, Gi4 const index, void * co
       return gbTRUE;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2:
-      n2 = (Gn2 *) &(buffer[index * 2]);
+      n2 = (Gn2 *) &(buffer[index * 4]);
       n2[0] = N4ToN2(r);
       n2[1] = N4ToN2(a);
       return gbTRUE;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN4:
-      n4 = (Gn4 *) &(buffer[index * 4]);
+      n4 = (Gn4 *) &(buffer[index * 8]);
       n4[0] = (Gn4) r;
       n4[1] = (Gn4) a;
       return gbTRUE;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR4:
-      r4 = (Gr4 *) &(buffer[index * 4]);
+      r4 = (Gr4 *) &(buffer[index * 8]);
       r4[0] = (Gr4) N4ToR(r);
       r4[1] = (Gr4) N4ToR(a);
       return gbTRUE;
 
    case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR8:
-      r8 = (Gr8 *) &(buffer[index * 8]);
+      r8 = (Gr8 *) &(buffer[index * 16]);
       r8[0] = N4ToR(r);
       r8[1] = N4ToR(a);
       return gbTRUE;
@@ -1171,6 +1843,44 @@ gimgioAPI Gb gimgioSetRow(Gimgio * const img, Gi4 const index)
    greturn gbTRUE;
 }
 
+/******************************************************************************
+func: gimgioSetThreadCount
+
+Set the number of threads a codec may use.  0 for all cores.  1, the 
+default, keeps everything on the calling thread.  The png writer compresses
+bands on each, the png reader decodes on a second thread while rows are 
+converted on the calling one.  The jpeg reader decodes bands of the image on
+each when the file has restart markers.
+******************************************************************************/
+gimgioAPI Gb gimgioSetThreadCount(Gimgio * const img, Gcount const count)
+{
+   genter;
+
+   greturnFalseIf(
+      !img ||
+      count < 0);
+
+   img->threadCount = count;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: gimgioSetSimd
+
+Turn the vectorized conversion kernels on or off.  Off uses the plain C
+reference kernels which is useful to validate the results.  Call after 
+gimgioStart.
+******************************************************************************/
+gimgioAPI void gimgioSetSimd(Gb const value)
+{
+   genter;
+
+   simdioStart(value ? simdioLevelMAX : simdioLevelSCALAR);
+
+   greturn;
+}
+
 /******************************************************************************
 func: gimgioSetTypeFile
 
@@ -1238,6 +1948,12 @@ Start the gimgio routines.
 gimgioAPI Gb gimgioStart(void)
 {
    genter;
+
+   // Pick the conversion kernels for this CPU.
+   simdioStart(simdioLevelMAX);
+
+   greturnFalseIf(!memioStart());
+
    greturn gbTRUE;
 }
 
@@ -1249,13 +1965,491 @@ Clean up.
 gimgioAPI void gimgioStop(void)
 {
    genter;
+
+   memioStop();
+
    greturn;
 }
 
+/******************************************************************************
+func: gimgioTranscode
+
+Copy the current image of src into dst a row at a time.  src is open for 
+reading, dst for writing.  dst takes src's width and height.  If dst has no
+file type yet it gets the hand over type.  Set anything else on dst, like 
+the compression, before calling.
+
+With threads the decode, the conversion and the encode each get a thread,
+the calling thread being the encode.  They hand rows on through a ring of
+option->rowCount rows.  The ring does not grow with the image height but 
+the codecs may, the BMP reader still decodes the whole image.  option can 
+be NULL for the defaults.  src's and dst's pixel types are put back when 
+done.
+******************************************************************************/
+gimgioAPI Gb gimgioTranscode(Gimgio * const src, Gimgio * const dst, 
+   GimgioTranscodeOption const * const option)
+{
+   genter;
+
+   GimgioTranscode  tc;
+   GimgioType       type,
+                    typePixelSrc,
+                    typePixelDst;
+   Gcount           threadCount;
+   Gindex           row;
+   TaskioThread    *threadDecode;
+   TaskioThread    *threadConvert;
+   Gb               result;
+
+   greturnFalseIf(
+      !src                         ||
+      !dst                         ||
+      src->mode != gimgioOpenREAD  ||
+      dst->mode != gimgioOpenWRITE ||
+      src->width  <= 0             ||
+      src->height <= 0);
+
+   // Both pixel types are put back on the way out.
+   typePixelSrc = src->typePixel;
+   typePixelDst = dst->typePixel;
+
+   type        = gimgioTypeNONE;
+   threadCount = 0;
+   gmemClear(&tc, gsizeof(GimgioTranscode));
+   if (option)
+   {
+      type        = option->type;
+      threadCount = option->threadCount;
+      tc.rowCount = option->rowCount;
+   }
+   if (type == gimgioTypeNONE)
+   {
+      type = src->typeFile;
+   }
+   if (threadCount == 0)
+   {
+      threadCount = taskioGetCoreCount();
+   }
+   if (tc.rowCount <= 0)
+   {
+      tc.rowCount = gimgioTranscodeROW_COUNT;
+   }
+
+   // Set up the destination.  The codec may pick a close file type instead.
+   dst->width  = src->width;
+   dst->height = src->height;
+   if (dst->typeFile == gimgioTypeNONE)
+   {
+      // FALSE only means the codec picked a close type.  Rows still come in 
+      // as type, the codec converts them.
+      gimgioSetTypeFile(dst, type);
+   }
+
+   // Decode in the file's own type.  The conversion is its own stage.
+   src->typePixel  = src->typeFile;
+   dst->typePixel  = type;
+
+   tc.src          = src;
+   tc.dst          = dst;
+   tc.isConverting = (src->typeFile != type);
+   tc.rowInSize    = gimgioGetPixelSize(src->typeFile, src->width);
+   tc.rowOutSize   = gimgioGetPixelSize(type,          src->width);
+
+   // Without threads one row is all it takes.
+   if (threadCount == 1)
+   {
+      tc.rowCount = 1;
+   }
+
+   threadDecode  = NULL;
+   threadConvert = NULL;
+   result        = gbFALSE;
+
+   breakScope
+   {
+      tc.rowIn  = memioCreateTypeArray(NULL, Gn1, tc.rowCount * tc.rowInSize);
+      tc.rowOut = tc.rowIn;
+      if (tc.isConverting)
+      {
+         tc.rowOut = memioCreateTypeArray(NULL, Gn1, tc.rowCount * tc.rowOutSize);
+      }
+      breakIf(
+         !tc.rowIn ||
+         !tc.rowOut);
+
+      if (threadCount == 1)
+      {
+         forCount(row, src->height)
+         {
+            src->row = row;
+            breakIf(!src->GetPixelRow(src, tc.rowIn));
+
+            if (tc.isConverting)
+            {
+               gimgioConvert(src->width, src->typeFile, tc.rowIn, type, tc.rowOut);
+            }
+
+            dst->row = row;
+            breakIf(!dst->SetPixelRow(dst, tc.rowOut));
+         }
+
+         result = (row == src->height);
+         break;
+      }
+
+      tc.lock   = taskioLockCreate();
+      tc.signal = taskioSignalCreate();
+      breakIf(
+         !tc.lock ||
+         !tc.signal);
+
+      threadDecode = taskioThreadCreate(_TranscodeDecode, &tc);
+      breakIf(!threadDecode);
+
+      if (tc.isConverting)
+      {
+         threadConvert = taskioThreadCreate(_TranscodeConvert, &tc);
+         if (!threadConvert)
+         {
+            _TranscodeSetIndex(&tc, &tc.converted, 0, gbFALSE);
+         }
+      }
+
+      _TranscodeEncode(&tc);
+
+      taskioThreadDestroy(threadConvert);
+      taskioThreadDestroy(threadDecode);
+
+      result = !tc.isError;
+   }
+
+   taskioSignalDestroy(tc.signal);
+   taskioLockDestroy(  tc.lock);
+   if (tc.rowOut != tc.rowIn)
+   {
+      memioDestroyBuffer(NULL, tc.rowOut);
+   }
+   memioDestroyBuffer(NULL, tc.rowIn);
+
+   src->typePixel = typePixelSrc;
+   dst->typePixel = typePixelDst;
+
+   greturn result;
+}
+
 /******************************************************************************
 local: 
 function:
 ******************************************************************************/
+/******************************************************************************
+func: _BatchLoad
+
+Load one file of a gimgioBatchLoad.  Runs on any of the batch threads.
+******************************************************************************/
+static void _BatchLoad(void * const data, Gindex const index)
+{
+   genter;
+
+   GimgioBatch       *batch;
+   GimgioBatchResult *result;
+   Gimgio            *imgio;
+   Gsize              pixelSize;
+   Gsize              memory;
+   Gn1               *pixelBuffer;
+
+   batch  = (GimgioBatch *) data;
+   result = &batch->resultList[index];
+
+   greturnVoidIf(!batch->filenameList[index]);
+
+   // Only the header is read here.
+   imgio = gimgioOpen(batch->filenameList[index], gimgioOpenREAD, gimgioFormatNONE);
+   greturnVoidIf(!imgio);
+
+   // The batch already has all the threads.
+   imgio->threadCount = 1;
+
+   pixelSize = gimgioGetPixelSize(batch->type, imgio->width);
+   memory    = pixelSize * imgio->height;
+
+   // Wait for room.  Something else must be in flight to wait on.
+   taskioLockOn(batch->lock);
+   while (batch->memoryMax                               &&
+          batch->memoryInUse                             &&
+          batch->memoryInUse + memory > batch->memoryMax)
+   {
+      taskioSignalWait(batch->signal, batch->lock);
+   }
+   batch->memoryInUse += memory;
+   taskioLockOff(batch->lock);
+
+   breakScope
+   {
+      pixelBuffer = gmemCreateTypeArray(Gn1, memory);
+      breakIf(!pixelBuffer);
+
+      if (!gimgioLoadInto(imgio, pixelBuffer, pixelSize, batch->type))
+      {
+         gmemDestroy(pixelBuffer);
+         break;
+      }
+
+      result->width    = imgio->width;
+      result->height   = imgio->height;
+      result->pixel    = pixelBuffer;
+      result->isLoaded = gbTRUE;
+   }
+
+   gimgioClose(imgio);
+
+   taskioLockOn(batch->lock);
+   batch->memoryInUse -= memory;
+   taskioSignalWakeAll(batch->signal);
+   taskioLockOff(batch->lock);
+
+   greturn;
+}
+
+/******************************************************************************
+func: _ConvertBlackAlphaN1ToRgbaN1
+
+Gray with alpha to RGBA.  count is in pixels.
+******************************************************************************/
+static void _ConvertBlackAlphaN1ToRgbaN1(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   forCount(index, count)
+   {
+      out[index * 4 + 0] = 
+         out[index * 4 + 1] = 
+         out[index * 4 + 2] = in[index * 2];
+      out[index * 4 + 3] = in[index * 2 + 1];
+   }
+}
+
+/******************************************************************************
+func: _ConvertBlackN1ToRgbaN1
+
+Gray to RGBA with an opaque alpha.  count is in pixels.
+******************************************************************************/
+static void _ConvertBlackN1ToRgbaN1(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   forCount(index, count)
+   {
+      out[index * 4 + 0] = 
+         out[index * 4 + 1] = 
+         out[index * 4 + 2] = in[index];
+      out[index * 4 + 3] = 0xff;
+   }
+}
+
+/******************************************************************************
+func: _ConvertGetChannelCount
+
+Get the number of channels in a type.
+******************************************************************************/
+static Gi4 _ConvertGetChannelCount(GimgioType const type)
+{
+   switch (type & typeCHANNEL)
+   {
+   case gimgioTypeBLACK:                     return 1;
+   case gimgioTypeBLACK | gimgioTypeALPHA:   return 2;
+   case gimgioTypeRGB:                       return 3;
+   case gimgioTypeRGB   | gimgioTypeALPHA:   return 4;
+   }
+
+   return 0;
+}
+
+/******************************************************************************
+func: _ConvertGetFunc
+
+Find the row kernel for the type pair.  NULL if there isn't one and the 
+generic path needs to be used.  countScale is what the width needs to be 
+multiplied by to get the count the kernel expects.
+
+The kernels need to produce exactly what the generic path would produce.
+******************************************************************************/
+static GimgioConvertFunc _ConvertGetFunc(GimgioType const inType, GimgioType const outType, 
+   Gi4 * const countScale)
+{
+   *countScale = 1;
+
+   // Same channels, only the channel size changes.  Kernels work on channel
+   // values instead of pixels.
+   if ((inType & typeCHANNEL) == (outType & typeCHANNEL))
+   {
+      *countScale = _ConvertGetChannelCount(inType);
+
+      if      ((inType & typeSIZE) == gimgioTypeN2 &&
+               (outType & typeSIZE) == gimgioTypeN1)
+      {
+         return simdioGetFunc(simdioKernelN2_TO_N1);
+      }
+      else if ((inType & typeSIZE) == gimgioTypeN1 &&
+               (outType & typeSIZE) == gimgioTypeN2)
+      {
+         return simdioGetFunc(simdioKernelN1_TO_N2);
+      }
+      else if ((inType & typeSIZE) == gimgioTypeN1 &&
+               (outType & typeSIZE) == gimgioTypeR4)
+      {
+         return _ConvertN1ToR4;
+      }
+
+      return NULL;
+   }
+
+   // Only N1 to N1 channel changes from here on.
+   if ((inType  & typeSIZE) != gimgioTypeN1 ||
+       (outType & typeSIZE) != gimgioTypeN1)
+   {
+      return NULL;
+   }
+
+   switch (inType & typeCHANNEL)
+   {
+   case gimgioTypeBLACK:
+      if ((outType & typeCHANNEL) == gimgioTypeRGB)
+      {
+         return simdioGetFunc(simdioKernelBLACK_TO_RGB);
+      }
+      if ((outType & typeCHANNEL) == (gimgioTypeRGB | gimgioTypeALPHA))
+      {
+         return _ConvertBlackN1ToRgbaN1;
+      }
+      break;
+
+   case gimgioTypeBLACK | gimgioTypeALPHA:
+      if ((outType & typeCHANNEL) == (gimgioTypeRGB | gimgioTypeALPHA))
+      {
+         return _ConvertBlackAlphaN1ToRgbaN1;
+      }
+      break;
+
+   case gimgioTypeRGB:
+      if ((outType & typeCHANNEL) == (gimgioTypeRGB | gimgioTypeALPHA))
+      {
+         return simdioGetFunc(simdioKernelRGB_TO_RGBA);
+      }
+      break;
+
+   case gimgioTypeRGB | gimgioTypeALPHA:
+      if ((outType & typeCHANNEL) == gimgioTypeRGB)
+      {
+         return simdioGetFunc(simdioKernelRGBA_TO_RGB);
+      }
+      break;
+   }
+
+   return NULL;
+}
+
+/******************************************************************************
+func: _ConvertN1ToR4
+
+8 bit channels to float.  count is in channel values.
+******************************************************************************/
+static void _ConvertN1ToR4(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4  index;
+   Gr4 *r4;
+
+   r4 = (Gr4 *) out;
+
+   forCount(index, count)
+   {
+      r4[index] = (Gr4) N4ToR(N1ToN4(in[index]));
+   }
+}
+
+/******************************************************************************
+func: _GetFormatFromStream
+
+Find the format from the first bytes without moving on.
+******************************************************************************/
+static GimgioFormat _GetFormatFromStream(Streamio * const stream)
+{
+   genter;
+
+   Gn1    buffer[16];
+   Gcount count;
+
+   count = streamioPeek(stream, 16, buffer);
+
+   greturn gimgioGetFormatFromContent(count, buffer);
+}
+
+/******************************************************************************
+func: _OpenStream
+
+The rest of gimgioOpenMemory_ and gimgioOpenStream_.  The stream is the 
+image's from here, even when this fails.
+******************************************************************************/
+static Gimgio *_OpenStream(Streamio * const stream, GimgioOpenMode const mode, 
+   GimgioFormat const format)
+{
+   genter;
+
+   Gimgio *img;
+
+   img = NULL;
+
+   breakScope
+   {
+      breakIf(
+         mode == gimgioOpenNONE ||
+         (mode   == gimgioOpenWRITE &&
+          format == gimgioFormatNONE));
+
+      img = gmemCreateType(Gimgio);
+      breakIf(!img);
+
+      img->mode        = mode;
+      img->format      = format;
+      img->stream      = stream;
+      img->compression = gimgioCompressionDEFAULT / 100.;
+      img->threadCount = 1;
+      img->decodeScale = 1;
+
+      img->memory      = memioCreate();
+      breakIf(!img->memory);
+
+      if (img->format == gimgioFormatNONE)
+      {
+         img->format = _GetFormatFromStream(img->stream);
+      }
+
+      // These open the file themselves.
+      breakIf(
+         img->format == gimgioFormatNONE ||
+         img->format == gimgioFormatGIF  ||
+         img->format == gimgioFormatTIFF);
+
+      breakIf(!_Start(img));
+
+      if (img->mode == gimgioOpenREAD)
+      {
+         breakIf(!img->ReadStart(img));
+      }
+
+      greturn img;
+   }
+
+   // Clean up
+   streamioDestroy(stream);
+   if (img)
+   {
+      memioDestroy(img->memory);
+      gmemDestroy(img);
+   }
+
+   greturn NULL;
+}
+
 /******************************************************************************
 func: _Start
 
@@ -1281,10 +2475,155 @@ static Gb _Start(Gimgio * const img)
    case gimgioFormatPPM:  greturn gbFALSE; //greturnFalseIf(!ppmioCreateContent(img)); break;
    case gimgioFormatRLE:  greturn gbFALSE; //greturnFalseIf(!rleioCreateContent(img)); break;
    case gimgioFormatTRG:  greturn gbFALSE; //greturnFalseIf(!trgioCreateContent(img));  break;
-#if defined(GIMGIO_ITFF)
+#if defined(GIMGIO_TIFF)
    case gimgioFormatTIFF: greturnFalseIf(!tifioCreateContent( img)); break;
 #endif
+   // No codec compiled in for this format.
+   default:               greturn gbFALSE;
    }
 
    greturn gbTRUE;
 }
+
+/******************************************************************************
+func: _TranscodeConvert
+
+Conversion stage.  Converts the decoded rows to the hand over type.
+******************************************************************************/
+static void _TranscodeConvert(void * const data)
+{
+   genter;
+
+   GimgioTranscode *tc;
+   Gindex           row;
+   Gindex           slot;
+
+   tc = (GimgioTranscode *) data;
+
+   forCount(row, tc->src->height)
+   {
+      breakIf(!_TranscodeWait(tc, &tc->decoded, row + 1));
+
+      slot = row % tc->rowCount;
+      gimgioConvert(
+         tc->src->width, 
+         tc->src->typeFile, 
+         &tc->rowIn[ slot * tc->rowInSize], 
+         tc->dst->typePixel, 
+         &tc->rowOut[slot * tc->rowOutSize]);
+
+      _TranscodeSetIndex(tc, &tc->converted, row + 1, gbTRUE);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _TranscodeDecode
+
+Decode stage.  Stays at most a ring ahead of the encode.
+******************************************************************************/
+static void _TranscodeDecode(void * const data)
+{
+   genter;
+
+   GimgioTranscode *tc;
+   Gindex           row;
+   Gb               isOk;
+
+   tc = (GimgioTranscode *) data;
+
+   forCount(row, tc->src->height)
+   {
+      // The slot is free once the encode is done with the row a ring back.
+      breakIf(!_TranscodeWait(tc, &tc->encoded, row + 1 - tc->rowCount));
+
+      tc->src->row = row;
+      isOk         = tc->src->GetPixelRow(
+         tc->src, 
+         &tc->rowIn[(row % tc->rowCount) * tc->rowInSize]);
+
+      _TranscodeSetIndex(tc, &tc->decoded, row + 1, isOk);
+      breakIf(!isOk);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _TranscodeEncode
+
+Encode stage.  Runs on the calling thread.
+******************************************************************************/
+static void _TranscodeEncode(GimgioTranscode * const tc)
+{
+   genter;
+
+   Gindex row;
+   Gb     isOk;
+
+   forCount(row, tc->dst->height)
+   {
+      breakIf(!_TranscodeWait(tc, tc->isConverting ? &tc->converted : &tc->decoded, row + 1));
+
+      tc->dst->row = row;
+      isOk         = tc->dst->SetPixelRow(
+         tc->dst, 
+         &tc->rowOut[(row % tc->rowCount) * tc->rowOutSize]);
+
+      _TranscodeSetIndex(tc, &tc->encoded, row + 1, isOk);
+      breakIf(!isOk);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _TranscodeSetIndex
+
+A stage is done with a row, or failed.  Either way wake the others.
+******************************************************************************/
+static void _TranscodeSetIndex(GimgioTranscode * const tc, Gindex * const index, 
+   Gindex const value, Gb const isOk)
+{
+   genter;
+
+   taskioLockOn(tc->lock);
+   if (isOk)
+   {
+      *index = value;
+   }
+   else
+   {
+      tc->isError = gbTRUE;
+   }
+   taskioSignalWakeAll(tc->signal);
+   taskioLockOff(tc->lock);
+
+   greturn;
+}
+
+/******************************************************************************
+func: _TranscodeWait
+
+Wait for another stage to get index up to value.  gbFALSE when a stage 
+failed instead.
+******************************************************************************/
+static Gb _TranscodeWait(GimgioTranscode * const tc, Gindex const * const index, 
+   Gindex const value)
+{
+   genter;
+
+   Gb isOk;
+
+   taskioLockOn(tc->lock);
+   while (!tc->isError &&
+          *index < value)
+   {
+      taskioSignalWait(tc->signal, tc->lock);
+   }
+   isOk = !tc->isError;
+   taskioLockOff(tc->lock);
+
+   greturn isOk;
+}
@@ -9,6 +9,12 @@ Image IO routines.  Handles the standard image formats like png, jpeg,
 bmp.  This will never be as complete as LEADTOOLs or image magic.  This
 is meant only to handle the 'major' formats and leave the rest.
 
+Threads: call gimgioStart once before any other thread uses the library.
+After that different Gimgio handles can be used on different threads at the
+same time.  One handle is only ever used by one thread at a time.  
+gimgioSetSimd changes the kernels for everyone so don't call it while 
+images are being read or written.
+
 ******************************************************************************/
 
 #if !defined(GIMGIOH)
@@ -88,6 +94,18 @@ typedef enum
    gimgioFormatTIFF,
 } GimgioFormat;
 
+// Presets for gimgioSetCompression.
+#define gimgioCompressionNONE       0.
+#define gimgioCompressionFASTEST    1.
+#define gimgioCompressionDEFAULT   66.
+#define gimgioCompressionBEST     100.
+
+// Rows in flight between the gimgioTranscode stages by default.
+#define gimgioTranscodeROW_COUNT   16
+
+// IO buffer size until gimgioSetBufferSize.
+#define gimgioBufferSIZE           (256 * 1024)
+
 /******************************************************************************
 type: 
 ******************************************************************************/
@@ -98,7 +116,9 @@ typedef struct _Gimgio
 #else
    void           *tiffFile;
 #endif
-   Gfile          *file;
+   // Where the bytes come from or go to.
+   struct Streamio *stream;
+   // NULL when not opened from a file.
    Gs             *fileName;
    GimgioOpenMode  mode;
    GimgioFormat    format;
@@ -111,38 +131,125 @@ typedef struct _Gimgio
    Gcount          height;
    Gindex          row;
    Gr              compression;
+   // gimgioSetCompression was called.  Codecs whose default isn't 
+   // gimgioCompressionDEFAULT keep their own until then.
+   Gb              isCompressionSet;
+   // Threads a codec may use.  0 for all cores.
+   Gcount          threadCount;
+   // Reading, decode at 1/decodeScale of the size.  1, 2, 4 or 8.
+   Gcount          decodeScale;
+   // Where the codec memory comes from.
+   struct Memio   *memory;
    
    // specific to the image formats
    void           *data;
    void          (*DestroyContent)(struct _Gimgio * const img);
    Gb            (*GetPixelRow)(   struct _Gimgio * const img, void * const pixel);
+   // Optional.  Codecs that can hand out a row without a copy.
+   void const   *(*GetPixelRowPointer)(struct _Gimgio * const img);
    Gb            (*ReadStart)(     struct _Gimgio * const img);
+   // Optional.  Forget the file but keep what can be reused for the next 
+   // one of the same format.  See gimgioReopen.
+   Gb            (*Reset)(         struct _Gimgio * const img);
+   // Optional.  Codecs that can decode at a reduced size.  Applies 
+   // decodeScale and updates width and height.
+   Gb            (*SetDecodeScale)(struct _Gimgio * const img);
    Gb            (*SetImageIndex)( struct _Gimgio * const img, Gindex const index);
    Gb            (*SetPixelRow)(   struct _Gimgio * const img, void * const pixel);
    Gb            (*SetTypeFile)(   struct _Gimgio * const img);
 } Gimgio;
 
+// What gimgioProbe finds out about a file.
+typedef struct
+{
+   GimgioFormat    format;
+   GimgioType      typeFile;
+   Gcount          imageCount;
+   Gcount          width;
+   Gcount          height;
+} GimgioInfo;
+
+// What gimgioBatchLoad did with one file.  pixel is for the caller to 
+// gmemDestroy, as with gimgioLoad.
+typedef struct
+{
+   Gb              isLoaded;
+   Gcount          width;
+   Gcount          height;
+   void           *pixel;
+} GimgioBatchResult;
+
+// The caller's own stream for gimgioOpenStream.  Positions are from the 
+// start.
+typedef struct
+{
+   // Reading.  Fill buffer with up to count bytes.  Returns the count read,
+   // 0 at the end.
+   Gcount        (*Get)(        void * const user, Gcount const count, void * const buffer);
+   // Writing.  Write all count bytes.
+   Gb            (*Set)(        void * const user, Gcount const count, void const * const buffer);
+   // Optional.  Go to a position.  Without it reading can only go forward
+   // and formats that write out of order can't be written.
+   Gb            (*SetPosition)(void * const user, GfileIndex const position);
+   void           *user;
+} GimgioStream;
+
+// Where the codecs get their memory.  See gimgioSetAllocator.  Create does 
+// not have to zero.  Both have to be safe to call from any thread.
+typedef struct
+{
+   void         *(*Create)( void * const user, Gsize const size);
+   void          (*Destroy)(void * const user, void * const buffer);
+   void           *user;
+   // Each image gets its own arena off Create.  Nothing is given back until
+   // gimgioClose lets the whole arena go at once.
+   Gb              isArena;
+} GimgioAllocator;
+
+// How gimgioTranscode runs.  All 0 for the defaults.
+typedef struct
+{
+   // Pixel type rows are handed over in.  NONE for the source's file type.
+   GimgioType      type;
+   // Rows in flight between the stages.  0 for gimgioTranscodeROW_COUNT.
+   Gcount          rowCount;
+   // 1 keeps it all on the calling thread.  0 to use threads when there 
+   // is more than one core.
+   Gcount          threadCount;
+} GimgioTranscodeOption;
+
 /******************************************************************************
 prototype: 
 ******************************************************************************/
 #define gimgioOpen(file, mode, format) \
    ((Gimgio *) gleakCreate((void *) gimgioOpen_(file, mode, format), gsizeof(Gimgio)))
+#define gimgioOpenMemory(buffer, count, format) \
+   ((Gimgio *) gleakCreate((void *) gimgioOpenMemory_(buffer, count, format), gsizeof(Gimgio)))
+#define gimgioOpenStream(stream, mode, format) \
+   ((Gimgio *) gleakCreate((void *) gimgioOpenStream_(stream, mode, format), gsizeof(Gimgio)))
+
+gimgioAPI Gb           gimgioBatchLoad(         Gpath const * const * const filenameList, Gcount const count, GimgioType const type, GimgioBatchResult * const resultList, Gcount const threadCount, Gsize const memoryMax);
 
 gimgioAPI void         gimgioClose(             Gimgio       * const img);
 gimgioAPI void         gimgioConvert(           Gi4 const width, GimgioType const inType, void const * const in, GimgioType const outType, void * const out);
 
 gimgioAPI Gr           gimgioGetCompression(    Gimgio const * const img);
+gimgioAPI Gcount       gimgioGetDecodeScale(    Gimgio const * const img);
 gimgioAPI GimgioFormat gimgioGetFormat(         Gimgio const * const img);
+gimgioAPI GimgioFormat gimgioGetFormatFromContent(Gcount const count, Gn1 const * const buffer);
+gimgioAPI GimgioFormat gimgioGetFormatFromFile( Gfile * const file);
 gimgioAPI GimgioFormat gimgioGetFormatFromName( Gpath const * const path);
 gimgioAPI Gcount       gimgioGetHeight(         Gimgio const * const img);
 gimgioAPI Gcount       gimgioGetImageCount(     Gimgio const * const img);
 gimgioAPI Gindex       gimgioGetImageIndex(     Gimgio const * const img);
 gimgioAPI Gb           gimgioGetPixelRow(       Gimgio       * const img, void * const pixel);
 gimgioAPI Gb           gimgioGetPixelRowAll(    Gimgio       * const img, Gn1 * const pixel);
+gimgioAPI void const  *gimgioGetPixelRowPointer(Gimgio       * const img);
 gimgioAPI Gsize        gimgioGetPixelSize(      GimgioType const type, Gi4 const width);
 gimgioAPI void         gimgioGetPixelAtN(       GimgioType const type, Gi4 const index, void * const pixel, Gn4 * const r, Gn4 * const g, Gn4 * const b, Gn4 * const a);
 gimgioAPI void         gimgioGetPixelAtR(       GimgioType const type, Gi4 const index, void * const pixel, Gr * const r, Gr * const g, Gr * const b, Gr * const a);
 gimgioAPI Gindex       gimgioGetRow(            Gimgio const * const img);
+gimgioAPI Gcount       gimgioGetThreadCount(    Gimgio const * const img);
 gimgioAPI GimgioType   gimgioGetTypeFile(       Gimgio const * const img);
 gimgioAPI GimgioType   gimgioGetTypePixel(      Gimgio const * const img);
 gimgioAPI Gcount       gimgioGetWidth(          Gimgio const * const img);
@@ -151,15 +258,29 @@ gimgioAPI Gb           gimgioIsStarted(         void);
 
 gimgioAPI Gb           gimgioLoad(              Gpath const * const filename, GimgioType const type, Gcount * const width, Gcount * const height, void ** const pixel);
 
+gimgioAPI Gb           gimgioLoadInto(          Gimgio       * const img, void * const buffer, Gsize const rowStride, GimgioType const type);
+
 gimgioAPI Gimgio      *gimgioOpen_(             Gpath const * const filename, GimgioOpenMode const mode, GimgioFormat const format);
+gimgioAPI Gimgio      *gimgioOpenMemory_(       void const * const buffer, Gsize const count, GimgioFormat const format);
+gimgioAPI Gimgio      *gimgioOpenStream_(       GimgioStream const * const stream, GimgioOpenMode const mode, GimgioFormat const format);
 
+gimgioAPI Gb           gimgioProbe(             Gpath const * const filename, GimgioInfo * const info);
+
+gimgioAPI Gb           gimgioReopen(            Gimgio       * const img, Gpath const * const filename);
+
+gimgioAPI void         gimgioSetAllocator(      GimgioAllocator const * const allocator);
+gimgioAPI void         gimgioSetBufferSize(     Gsize const size);
 gimgioAPI Gb           gimgioSetCompression(    Gimgio       * const img, Gr const amount);
+gimgioAPI Gb           gimgioSetDecodeScale(    Gimgio       * const img, Gcount const scale);
+gimgioAPI Gb           gimgioSetDecodeSizeMax(  Gimgio       * const img, Gcount const size);
 gimgioAPI Gb           gimgioSetHeight(         Gimgio       * const img, Gcount const height);
 gimgioAPI Gb           gimgioSetImageIndex(     Gimgio       * const img, Gindex const index);
 gimgioAPI Gb           gimgioSetPixelRow(       Gimgio       * const img, void * const pixel);
 gimgioAPI Gb           gimgioSetPixelAtN(       GimgioType const type, Gindex const index, void * const pixel, Gn4 const r, Gn4 const g, Gn4 const b, Gn4 const a);   
 gimgioAPI Gb           gimgioSetPixelAtR(       GimgioType const type, Gindex const index, void * const pixel, Gr const r, Gr const g, Gr const b, Gr const a);   
+gimgioAPI void         gimgioSetSimd(           Gb const value);
 gimgioAPI Gb           gimgioSetRow(            Gimgio       * const img, Gindex const index);
+gimgioAPI Gb           gimgioSetThreadCount(    Gimgio       * const img, Gcount const count);
 gimgioAPI Gb           gimgioSetTypeFile(       Gimgio       * const img, GimgioType const type);
 gimgioAPI Gb           gimgioSetTypePixel(      Gimgio       * const img, GimgioType const type);
 gimgioAPI Gb           gimgioSetWidth(          Gimgio       * const img, Gcount const width);
@@ -167,6 +288,8 @@ gimgioAPI Gb           gimgioSetWidth(          Gimgio       * const img, Gcount
 gimgioAPI Gb           gimgioStart(             void);
 gimgioAPI void         gimgioStop(              void);
 
+gimgioAPI Gb           gimgioTranscode(         Gimgio       * const src, Gimgio * const dst, GimgioTranscodeOption const * const option);
+
 #define B1ToN4(V)   (((Gn4) V) << 31)
 #define B2ToN4(V)   (((Gn4) V) << 30)
 #define B4ToN4(V)   (((Gn4) V) << 28)
@@ -5,27 +5,87 @@ author:     Robbert de Groot
 copyright:  2008-2008, Robbert de Groot
 
 description:
-png file handling.
+GRAW file handling.  Pixels are stored as is in any GimgioType.
+
+Header values are little endian.  Pixel rows are written as they are in 
+memory so they can be read straight out of the file.  That leaves channels 
+wider than a byte in the byte order of the machine that wrote them.  They 
+only read back right on a machine with the same byte order.
+
+File header, 32 bytes.
+   0  "GRAW"
+   4  Gn4 version, 2
+   8  Gn4 file header size
+   12 Gn4 image header size
+   16 Gn8 image count
+   24 Gn8 reserved
+
+Image header, 64 bytes, in front of every image.
+   0  Gn4 image header size
+   4  Gn4 GimgioType
+   8  Gn8 width
+   16 Gn8 height
+   24 Gn8 row stride, bytes from the start of one row to the next.
+   32 Gn4 alignment the rows start on.
+   36 Gn4 reserved
+   40 Gn8 pixel offset, from the image header to the first row.
+   48 Gn8 next offset, from the image header to the next image header.
+   56 Gn8 reserved
+
+Version 1 files, "GRAWRGB N1  W[width]H[height]" followed by packed RGB N1
+rows, are still read.
 
 ******************************************************************************/
 
 /******************************************************************************
-include: 
+include:
 ******************************************************************************/
 #include "precompiled.h"
 
 /******************************************************************************
-local: 
+local:
 type:
 ******************************************************************************/
 // GRAW + [channels] + [channel size] + W + [9 chars for width] + H + [9 chars for height]
-#define headerSIZE (4 + 4 + 4 + 1 + 9 + 1 + 9)
+#define headerSIZE_V1      (4 + 4 + 4 + 1 + 9 + 1 + 9)
 
-typedef struct 
+#define headerFileSIZE     32
+#define headerImageSIZE    64
+
+#define grawVERSION        2
+
+// Rows start on a 16 byte boundary so the row kernels get aligned data.
+#define grawALIGNMENT      16
+
+#define grawALIGN(V)       ((((V) + grawALIGNMENT - 1) / grawALIGNMENT) * grawALIGNMENT)
+
+typedef struct
 {
-   GfileIndex currentPos;
-   Gb         isFileSet;
-   Gn1       *row;
+   // Where the GRAW starts.  It may be inside another file.
+   GfileIndex  currentPos;
+   Gb          isVersion1;
+   // Current image.  Absolute file positions.
+   GfileIndex  pixelPos;
+   Gi8         rowStride;
+   // Reading.  Where each image header is.
+   GfileIndex *imagePosList;
+   // Writing.
+   Gb          isFileSet;
+   Gb          isImageSet;
+   GfileIndex  imageNextPos;
+   Gn1        *row;
+   Gsize       rowCapacity;
+   // Writing.  The row the file position is at and one past the last row
+   // written.
+   Gindex      rowAtPosition;
+   Gindex      rowEnd;
+   // Reading.  The file's bytes straight from memory, or mapped, owned by
+   // the stream.  NULL when they can't be had that way and rows are read 
+   // from the file instead.
+   Gn1 const  *map;
+   GfileIndex  mapCount;
+   Gn1 const  *mapPixel;
+   Gindex      mapRowLast;
 } Grawio;
 
 /******************************************************************************
@@ -35,19 +95,36 @@ prototype:
 static void _GrawDestroyContent(  Gimgio * const img);
 
 static Gb   _GrawGetPixelRow(     Gimgio * const img, void * const pixel);
+static void const *_GrawGetPixelRowPointer(Gimgio * const img);
 
 static Gb   _GrawReadStart(       Gimgio * const img);
+static Gb   _GrawReset(           Gimgio * const img);
 
 static Gb   _GrawSetImageIndex(   Gimgio * const img, Gi4 const index);
 static Gb   _GrawSetPixelRow(     Gimgio * const img, void * const pixel);
 static Gb   _GrawSetTypeFile(     Gimgio * const img);
 
 // local only.
+static Gn4  _GetN4(               Gn1 const * const buffer);
+static Gn8  _GetN8(               Gn1 const * const buffer);
+
+static Gn1 const *_MapGetRow(     Gimgio * const img, Grawio * const data);
+static void _MapStart(            Gimgio * const img, Grawio * const data);
+
+static Gb   _ReadImage(           Gimgio * const img, Grawio * const data, Gindex const index);
+static Gb   _ReadStartV1(         Gimgio * const img, Grawio * const data);
+
+static void _SetN4(               Gn1 * const buffer, Gn4 const value);
+static void _SetN8(               Gn1 * const buffer, Gn8 const value);
+
 static Gb   _StartFile(           Gimgio * const img, Grawio * const data);
+static Gb   _StartImage(          Gimgio * const img, Grawio * const data);
+static Gb   _StopFile(            Gimgio * const img, Grawio * const data);
+static Gb   _StopImage(           Gimgio * const img, Grawio * const data);
 
 /******************************************************************************
 global: to library only
-function: 
+function:
 ******************************************************************************/
 /******************************************************************************
 func: grawioCreateContent
@@ -60,24 +137,52 @@ Gb grawioCreateContent(Gimgio * const img)
 
    genter;
 
-   data = gmemCreateType(Grawio);
+   data = memioCreateType(img->memory, Grawio);
    greturnFalseIf(!data);
 
-   img->data           = data;
-   img->DestroyContent = _GrawDestroyContent;
-   img->GetPixelRow    = _GrawGetPixelRow;
-   img->ReadStart      = _GrawReadStart;
-   img->SetImageIndex  = _GrawSetImageIndex;
-   img->SetPixelRow    = _GrawSetPixelRow;
-   img->SetTypeFile    = _GrawSetTypeFile;
+   img->data               = data;
+   img->DestroyContent     = _GrawDestroyContent;
+   img->GetPixelRow        = _GrawGetPixelRow;
+   img->GetPixelRowPointer = _GrawGetPixelRowPointer;
+   img->ReadStart          = _GrawReadStart;
+   img->Reset              = _GrawReset;
+   img->SetImageIndex      = _GrawSetImageIndex;
+   img->SetPixelRow        = _GrawSetPixelRow;
+   img->SetTypeFile        = _GrawSetTypeFile;
 
    greturn gbTRUE;
 }
 
 /******************************************************************************
-local: 
+local:
 function:
 ******************************************************************************/
+/******************************************************************************
+func: _GetN4
+
+Get a little endian value.
+******************************************************************************/
+static Gn4 _GetN4(Gn1 const * const buffer)
+{
+   return
+      ((Gn4) buffer[0])       |
+      ((Gn4) buffer[1] <<  8) |
+      ((Gn4) buffer[2] << 16) |
+      ((Gn4) buffer[3] << 24);
+}
+
+/******************************************************************************
+func: _GetN8
+
+Get a little endian value.
+******************************************************************************/
+static Gn8 _GetN8(Gn1 const * const buffer)
+{
+   return
+      (Gn8) _GetN4(buffer) |
+      ((Gn8) _GetN4(&buffer[4]) << 32);
+}
+
 /******************************************************************************
 func: _GrawDestroyContent
 
@@ -91,9 +196,16 @@ static void _GrawDestroyContent(Gimgio * const img)
 
    data = (Grawio *) img->data;
 
+   // Writing
+   if (img->mode == gimgioOpenWRITE)
+   {
+      _StopFile(img, data);
+   }
+
    // Other clean up common to both.
-   gmemDestroy(data->row);
-   gmemDestroy(data);
+   memioDestroyBuffer(img->memory, data->imagePosList);
+   memioDestroyBuffer(img->memory, data->row);
+   memioDestroyBuffer(img->memory, data);
    img->data = NULL;
 
    greturn;
@@ -106,32 +218,59 @@ Read in a pixel row.
 ******************************************************************************/
 static Gb _GrawGetPixelRow(Gimgio * const img, void * const pixel)
 {
-   Grawio *data;
-   Gi8     position;
-   
+   Grawio    *data;
+   Gi8        position;
+   Gsize      rowSize;
+   Gn1 const *row;
+
    genter;
 
    data = (Grawio *) img->data;
 
+   // Mapped, no seek or read needed.
+   if (data->map)
+   {
+      row = _MapGetRow(img, data);
+      greturnFalseIf(!row);
+
+      gimgioConvert(
+         img->width,
+         img->typeFile,
+         row,
+         img->typePixel,
+         pixel);
+
+      greturn gbTRUE;
+   }
+
+   rowSize = gimgioGetPixelSize(img->typeFile, img->width);
+
    // Set the position in the file.
-   position = 
-      data->currentPos + 
-      headerSIZE       + 
-      img->row * gimgioGetPixelSize(img->typeFile, img->width);
-   greturnFalseIf(!gfileSetPosition(img->file, gpositionSTART, position));
-
-   // Allocate the row.
-   if (!data->row)
+   position = data->pixelPos + (Gi8) img->row * data->rowStride;
+   greturnFalseIf(!streamioSetPosition(img->stream, position));
+
+   // Same layout, read straight into the caller's row.
+   if (img->typePixel == img->typeFile)
+   {
+      greturnFalseIf(streamioGet(img->stream, rowSize, pixel) != rowSize);
+
+      greturn gbTRUE;
+   }
+
+   // Allocate the row.  Images may differ in size.
+   if (data->rowCapacity < rowSize)
    {
-      data->row = gmemCreateTypeArray(Gn1, gimgioGetPixelSize(img->typeFile, img->width));
+      memioDestroyBuffer(img->memory, data->row);
+      data->rowCapacity = 0;
+
+      data->row = memioCreateTypeArray(img->memory, Gn1, rowSize);
       greturnFalseIf(!data->row);
+
+      data->rowCapacity = rowSize;
    }
 
    // Get the pixels for the row.
-   gfileGet(
-      img->file, 
-      gimgioGetPixelSize(img->typeFile, img->width),
-      data->row);
+   greturnFalseIf(streamioGet(img->stream, rowSize, data->row) != rowSize);
 
    // Convert the pixel row to what we want.
    gimgioConvert(
@@ -144,6 +283,27 @@ static Gb _GrawGetPixelRow(Gimgio * const img, void * const pixel)
    greturn gbTRUE;
 }
 
+/******************************************************************************
+func: _GrawGetPixelRowPointer
+
+Get the row straight out of the mapping.  NULL when the file isn't mapped.
+******************************************************************************/
+static void const *_GrawGetPixelRowPointer(Gimgio * const img)
+{
+   Grawio    *data;
+   Gn1 const *row;
+
+   genter;
+
+   data = (Grawio *) img->data;
+
+   greturnNullIf(!data->map);
+
+   row = _MapGetRow(img, data);
+
+   greturn row;
+}
+
 /******************************************************************************
 func: _GrawReadStart
 
@@ -151,46 +311,91 @@ Read in the image information.
 ******************************************************************************/
 static Gb _GrawReadStart(Gimgio * const img)
 {
-   // no genter and greturn because of setjmp.
-   Char    ctemp[10];
+   Gn1     header[headerFileSIZE];
    Grawio *data;
+   Gn4     headerSize;
+   Gn8     imageCount;
+   Gindex  index;
 
    genter;
 
    data = (Grawio *) img->data;
 
-   data->currentPos = gfileGetPosition(img->file);
+   data->currentPos = streamioGetPosition(img->stream);
 
    // Check to see if the file is a GRAW.
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 4, ctemp);
-   greturnFalseIf(strcmp(ctemp, "GRAW"));
+   greturnFalseIf(
+      streamioGet(img->stream, 8, header) != 8 ||
+      memcmp(header, "GRAW", 4) != 0);
 
-   // Get the raw information.
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 4, ctemp);
-   greturnFalseIf(strcmp(ctemp, "RGB "));
+   // Version 1 has the ASCII type where the version is.
+   if (memcmp(&header[4], "RGB ", 4) == 0)
+   {
+      greturnFalseIf(!_ReadStartV1(img, data));
 
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 4, ctemp);
-   greturnFalseIf(strcmp(ctemp, "N1  "));
-   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
-   
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 1, ctemp);
-   greturnFalseIf(strcmp(ctemp, "W"));
+      _MapStart(img, data);
 
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 9, ctemp);
-   img->width = atoi(ctemp);
-   
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 1, ctemp);
-   greturnFalseIf(strcmp(ctemp, "H"));
+      greturn gbTRUE;
+   }
 
-   gmemClear(ctemp, 10);
-   gfileGet(img->file, 9, ctemp);
-   img->height = atoi(ctemp);
+   greturnFalseIf(
+      _GetN4(&header[4]) != grawVERSION ||
+      streamioGet(img->stream, headerFileSIZE - 8, &header[8]) != headerFileSIZE - 8);
+
+   headerSize = _GetN4(&header[8]);
+   imageCount = _GetN8(&header[16]);
+   greturnFalseIf(
+      headerSize <  headerFileSIZE ||
+      imageCount == 0              ||
+      imageCount >  0x7fffffff);
+
+   img->imageCount = (Gcount) imageCount;
+
+   // Find all the image headers.  Each one says where the next one is.
+   data->imagePosList = memioCreateTypeArray(img->memory, GfileIndex, img->imageCount);
+   greturnFalseIf(!data->imagePosList);
+
+   data->imagePosList[0] = data->currentPos + headerSize;
+   for (index = 1; index < img->imageCount; index++)
+   {
+      greturnFalseIf(
+         !streamioSetPosition(img->stream, data->imagePosList[index - 1] + 48) ||
+         streamioGet(img->stream, 8, header) != 8);
+
+      data->imagePosList[index] = data->imagePosList[index - 1] + (GfileIndex) _GetN8(header);
+   }
+
+   greturnFalseIf(!_ReadImage(img, data, 0));
+
+   _MapStart(img, data);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _GrawReset
+
+Ready for the next file.  The row buffer is kept.
+******************************************************************************/
+static Gb _GrawReset(Gimgio * const img)
+{
+   Grawio *data;
+   Gn1    *row;
+   Gsize   rowCapacity;
+
+   genter;
+
+   data = (Grawio *) img->data;
+
+   memioDestroyBuffer(img->memory, data->imagePosList);
+
+   row         = data->row;
+   rowCapacity = data->rowCapacity;
+
+   gmemClear(data, gsizeof(Grawio));
+
+   data->row         = row;
+   data->rowCapacity = rowCapacity;
 
    greturn gbTRUE;
 }
@@ -198,13 +403,56 @@ static Gb _GrawReadStart(Gimgio * const img)
 /******************************************************************************
 func: _GrawSetImageIndex
 
-GRAW doesn't support multiple images yet.
+Reading, any image can be picked.  Writing, images are written one after the
+other so only the next one can be started.
 ******************************************************************************/
 static Gb _GrawSetImageIndex(Gimgio * const img, Gi4 const index)
 {
+   Grawio *data;
+
    genter;
-   img; index;
-   return gbFALSE;
+
+   data = (Grawio *) img->data;
+
+   if (img->mode == gimgioOpenREAD)
+   {
+      greturnFalseIf(
+         data->isVersion1 ||
+         !_ReadImage(img, data, index));
+
+      if (data->map)
+      {
+         // The image may not all be there.  Read from the file instead.
+         if (data->mapCount <
+               data->pixelPos + (Gi8) img->height * data->rowStride)
+         {
+            data->map = NULL;
+         }
+         else
+         {
+            data->mapPixel   = data->map + data->pixelPos;
+            data->mapRowLast = -1;
+         }
+      }
+
+      greturn gbTRUE;
+   }
+
+   // Nothing written yet for the current image.  Stay with it.
+   greturnTrueIf(
+      index == img->imageIndex &&
+      !data->isImageSet);
+
+   greturnFalseIf(index != img->imageCount);
+
+   // Finish the current image.  The next one starts with its first row so
+   // the caller can still set its width, height and type.
+   if (data->isImageSet)
+   {
+      greturnFalseIf(!_StopImage(img, data));
+   }
+
+   greturn gbTRUE;
 }
 
 /******************************************************************************
@@ -216,34 +464,52 @@ static Gb _GrawSetPixelRow(Gimgio * const img, void * const pixel)
 {
    Grawio *data;
    Gi8     position;
+   Gsize   rowSize;
+   void   *row;
 
    genter;
 
    data = (Grawio *) img->data;
 
-   if (!data->isFileSet)
+   greturnFalseIf(
+      img->row < 0 ||
+      img->row >= img->height);
+
+   if (!data->isImageSet)
    {
-      greturnFalseIf(!_StartFile(img, data));
+      greturnFalseIf(!_StartImage(img, data));
    }
 
-   gimgioConvert(
-      img->width, 
-      img->typePixel,
-      pixel,
-      img->typeFile,
-      data->row);
+   rowSize = gimgioGetPixelSize(img->typeFile, img->width);
 
-   position = 
-      data->currentPos +
-      headerSIZE       +
-      img->row * gimgioGetPixelSize(img->typeFile, img->width);
-   greturnFalseIf(!gfileSetPosition(img->file, gpositionSTART, position));
+   // Same layout, write the caller's row as is.
+   row = pixel;
+   if (img->typePixel != img->typeFile)
+   {
+      gimgioConvert(
+         img->width,
+         img->typePixel,
+         pixel,
+         img->typeFile,
+         data->row);
+
+      row = data->row;
+   }
 
-   gfileSet(
-      img->file, 
-      gimgioGetPixelSize(img->typeFile, img->width),
-      data->row,
-      NULL);
+   // Rows in order are just appended.  Only seek when they are not or when
+   // the row stride has padding.  Seeking past the end leaves a gap the file
+   // system fills with zeros.
+   if (img->row       != data->rowAtPosition ||
+       data->rowStride != rowSize)
+   {
+      position = data->pixelPos + (Gi8) img->row * data->rowStride;
+      greturnFalseIf(!streamioSetPosition(img->stream, position));
+   }
+
+   greturnFalseIf(!streamioSet(img->stream, rowSize, row));
+
+   data->rowAtPosition = img->row + 1;
+   data->rowEnd        = gMAX(data->rowEnd, img->row + 1);
 
    greturn gbTRUE;
 }
@@ -251,53 +517,334 @@ static Gb _GrawSetPixelRow(Gimgio * const img, void * const pixel)
 /******************************************************************************
 func: _GrawSetTypeFile
 
-Ensure the file type is proper.
+Ensure the file type is proper.  Any type with a pixel size can be stored.
 ******************************************************************************/
 static Gb _GrawSetTypeFile(Gimgio * const img)
 {
-   Gb result;
+   genter;
+
+   greturnTrueIf(gimgioGetPixelSize(img->typeFile, 1) != 0);
+
+   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
+
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+func: _MapGetRow
+
+Get the current row out of the mapping.  Once rows are asked for out of
+order the OS is told not to bother reading ahead.
+******************************************************************************/
+static Gn1 const *_MapGetRow(Gimgio * const img, Grawio * const data)
+{
+   genter;
+
+   greturnNullIf(
+      img->row < 0 ||
+      img->row >= img->height);
+
+   if (img->row != data->mapRowLast + 1)
+   {
+      streamioSetAdvice(img->stream, mapioAdviceRANDOM);
+   }
+   data->mapRowLast = img->row;
+
+   greturn &data->mapPixel[(Gi8) img->row * data->rowStride];
+}
+
+/******************************************************************************
+func: _MapStart
+
+Get the file as memory if we can, a buffer the image was opened on or the 
+file mapped.  Reading a row is then just a pointer into it.  Fall back to 
+reading the file when that can't be done or doesn't hold the whole image.
+******************************************************************************/
+static void _MapStart(Gimgio * const img, Grawio * const data)
+{
+   genter;
+
+   data->map = streamioGetMemory(img->stream, &data->mapCount);
+   greturnVoidIf(!data->map);
+
+   if (data->mapCount <
+         data->pixelPos + (Gi8) img->height * data->rowStride)
+   {
+      data->map = NULL;
+
+      greturn;
+   }
+
+   // Most reads are top to bottom.
+   streamioSetAdvice(img->stream, mapioAdviceSEQUENTIAL);
+
+   data->mapPixel   = data->map + data->pixelPos;
+   data->mapRowLast = -1;
+
+   greturn;
+}
+
+/******************************************************************************
+func: _ReadImage
+
+Read in an image header and make it the current image.
+******************************************************************************/
+static Gb _ReadImage(Gimgio * const img, Grawio * const data, Gindex const index)
+{
+   Gn1        header[headerImageSIZE];
+   GimgioType type;
+   Gn8        width,
+              height,
+              rowStride,
+              pixelOffset;
+
+   genter;
+
+   greturnFalseIf(
+      index < 0                                                           ||
+      index >= img->imageCount                                            ||
+      !streamioSetPosition(img->stream, data->imagePosList[index]) ||
+      streamioGet(img->stream, headerImageSIZE, header) != headerImageSIZE);
+
+   type        = (GimgioType) _GetN4(&header[4]);
+   width       = _GetN8(&header[8]);
+   height      = _GetN8(&header[16]);
+   rowStride   = _GetN8(&header[24]);
+   pixelOffset = _GetN8(&header[40]);
+
+   greturnFalseIf(
+      _GetN4(header)              <  headerImageSIZE ||
+      gimgioGetPixelSize(type, 1) == 0               ||
+      width                       >  0x7fffffff      ||
+      height                      >  0x7fffffff      ||
+      rowStride                   <  (Gn8) gimgioGetPixelSize(type, (Gcount) width) ||
+      pixelOffset                 <  headerImageSIZE);
+
+   img->typeFile   = type;
+   img->width      = (Gcount) width;
+   img->height     = (Gcount) height;
+
+   data->pixelPos  = data->imagePosList[index] + (GfileIndex) pixelOffset;
+   data->rowStride = (Gi8) rowStride;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _ReadStartV1
+
+Read in the rest of a version 1 header.  "GRAWRGB " has been read.
+******************************************************************************/
+static Gb _ReadStartV1(Gimgio * const img, Grawio * const data)
+{
+   Char ctemp[10];
 
    genter;
 
-   result = (img->typeFile == (gimgioTypeRGB | gimgioTypeN1)) ? gbTRUE : gbFALSE;
-   
+   gmemClear(ctemp, 10);
+   streamioGet(img->stream, 4, ctemp);
+   greturnFalseIf(strcmp(ctemp, "N1  "));
    img->typeFile = gimgioTypeRGB | gimgioTypeN1;
 
-   greturn result;
+   gmemClear(ctemp, 10);
+   streamioGet(img->stream, 1, ctemp);
+   greturnFalseIf(strcmp(ctemp, "W"));
+
+   gmemClear(ctemp, 10);
+   streamioGet(img->stream, 9, ctemp);
+   img->width = atoi(ctemp);
+
+   gmemClear(ctemp, 10);
+   streamioGet(img->stream, 1, ctemp);
+   greturnFalseIf(strcmp(ctemp, "H"));
+
+   gmemClear(ctemp, 10);
+   streamioGet(img->stream, 9, ctemp);
+   img->height = atoi(ctemp);
+
+   img->imageCount = 1;
+
+   data->isVersion1 = gbTRUE;
+   data->pixelPos   = data->currentPos + headerSIZE_V1;
+   data->rowStride  = gimgioGetPixelSize(img->typeFile, img->width);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _SetN4
+
+Set a little endian value.
+******************************************************************************/
+static void _SetN4(Gn1 * const buffer, Gn4 const value)
+{
+   buffer[0] = (Gn1) (value);
+   buffer[1] = (Gn1) (value >>  8);
+   buffer[2] = (Gn1) (value >> 16);
+   buffer[3] = (Gn1) (value >> 24);
+}
+
+/******************************************************************************
+func: _SetN8
+
+Set a little endian value.
+******************************************************************************/
+static void _SetN8(Gn1 * const buffer, Gn8 const value)
+{
+   _SetN4(buffer,     (Gn4) value);
+   _SetN4(&buffer[4], (Gn4) (value >> 32));
 }
 
 /******************************************************************************
 func: _StartFile
 
-Write out the header and write out blank rows for the entire image.
+Write out the file header.  The image count is filled in at the end.
 ******************************************************************************/
 static Gb _StartFile(Gimgio * const img, Grawio * const data)
 {
-   Gi4 row;
-   Gn1 header[headerSIZE + 1];
+   Gn1 header[headerFileSIZE];
 
    genter;
 
-   sprintf_s((Char *) header, headerSIZE + 1, "GRAWRGB N1  W% 9dH% 9d", img->width, img->height);
-   
-   // Ensure the file type is what we expect.
-   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
+   gmemClear(header, headerFileSIZE);
+   memcpy(header, "GRAW", 4);
+   _SetN4(&header[4],  grawVERSION);
+   _SetN4(&header[8],  headerFileSIZE);
+   _SetN4(&header[12], headerImageSIZE);
 
    // Get our current position in case it may be inside another file.
-   data->currentPos = gfileGetPosition(img->file);
-   gfileSet(img->file, headerSIZE, header, NULL);
+   data->currentPos = streamioGetPosition(img->stream);
+   greturnFalseIf(!streamioSet(img->stream, headerFileSIZE, header));
+
+   data->imageNextPos = data->currentPos + headerFileSIZE;
+   data->isFileSet    = gbTRUE;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _StartImage
+
+Write out the image header.  Rows are written as they come.  Nothing is
+written ahead of time.
+******************************************************************************/
+static Gb _StartImage(Gimgio * const img, Grawio * const data)
+{
+   Gn1   header[headerImageSIZE];
+   Gi8   pixelOffset;
+   Gsize rowSize;
+
+   genter;
+
+   if (!data->isFileSet)
+   {
+      greturnFalseIf(!_StartFile(img, data));
+   }
+
+   // Ensure the file type is one we can store.
+   _GrawSetTypeFile(img);
+
+   rowSize         = gimgioGetPixelSize(img->typeFile, img->width);
+   pixelOffset     = grawALIGN(headerImageSIZE);
+
+   data->pixelPos  = data->imageNextPos + pixelOffset;
+   data->rowStride = grawALIGN((Gi8) rowSize);
+
+   gmemClear(header, headerImageSIZE);
+   _SetN4(&header[0],  headerImageSIZE);
+   _SetN4(&header[4],  (Gn4) img->typeFile);
+   _SetN8(&header[8],  (Gn8) img->width);
+   _SetN8(&header[16], (Gn8) img->height);
+   _SetN8(&header[24], (Gn8) data->rowStride);
+   _SetN4(&header[32], grawALIGNMENT);
+   _SetN8(&header[40], (Gn8) pixelOffset);
+   _SetN8(&header[48], (Gn8) (pixelOffset + data->rowStride * img->height));
+
+   greturnFalseIf(
+      !streamioSetPosition(img->stream, data->imageNextPos) ||
+      !streamioSet(img->stream, headerImageSIZE, header));
+
+   // Create the row buffer.  Images may differ in size.
+   if (data->rowCapacity < rowSize)
+   {
+      memioDestroyBuffer(img->memory, data->row);
+      data->rowCapacity = 0;
+
+      data->row = memioCreateTypeArray(img->memory, Gn1, rowSize);
+      greturnFalseIf(!data->row);
+
+      data->rowCapacity = rowSize;
+   }
+
+   // The header is padded out so the first row needs a seek.
+   data->rowAtPosition = (pixelOffset == headerImageSIZE) ? 0 : -1;
+   data->rowEnd        = 0;
+   data->isImageSet    = gbTRUE;
+
+   img->imageCount     = img->imageIndex + 1;
+
+   greturn gbTRUE;
+}
 
-   // Create the row buffer.
-   data->row = gmemCreateTypeArray(Gn1, gimgioGetPixelSize(img->typeFile, img->width));
-   greturnFalseIf(!data->row);
+/******************************************************************************
+func: _StopFile
+
+Finish the last image and fill in the image count.
+******************************************************************************/
+static Gb _StopFile(Gimgio * const img, Grawio * const data)
+{
+   Gn1 count[8];
+
+   genter;
+
+   // No rows were set.  Still write out a proper file.
+   if (!data->isFileSet)
+   {
+      greturnFalseIf(!_StartImage(img, data));
+   }
 
-   gmemClear(data->row, gimgioGetPixelSize(img->typeFile, img->width));
-   forCount(row, img->height)
+   if (data->isImageSet)
    {
-      gfileSet(img->file, gimgioGetPixelSize(img->typeFile, img->width), data->row, NULL);
+      greturnFalseIf(!_StopImage(img, data));
    }
 
-   data->isFileSet = gbTRUE;
+   _SetN8(count, (Gn8) img->imageCount);
+   greturnFalseIf(
+      !streamioSetPosition(img->stream, data->currentPos + 16) ||
+      !streamioSet(img->stream, 8, count));
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _StopImage
+
+Make sure the image is its full size in the file.  Rows never written read
+back as zeros.
+******************************************************************************/
+static Gb _StopImage(Gimgio * const img, Grawio * const data)
+{
+   Gi8 position;
+   Gn1 zero;
+
+   genter;
+
+   data->isImageSet   = gbFALSE;
+   data->imageNextPos = data->pixelPos + data->rowStride * img->height;
+
+   greturnTrueIf(
+      data->rowStride == 0 ||
+      img->height     == 0 ||
+      (data->rowEnd    == img->height &&
+       data->rowStride == gimgioGetPixelSize(img->typeFile, img->width)));
+
+   // Writing the last byte extends the file.  Everything skipped over is
+   // zero.
+   position = data->imageNextPos - 1;
+   greturnFalseIf(!streamioSetPosition(img->stream, position));
+
+   zero = 0;
+   greturnFalseIf(!streamioSet(img->stream, 1, &zero));
 
    greturn gbTRUE;
 }
@@ -24,7 +24,8 @@ include:
 local: 
 type:
 ******************************************************************************/
-#define BUF_SIZE  4096	/* choose an efficiently fwrite'able size */
+// First guess at the file size when a parallel decode reads it all in.
+#define FILE_BUF_SIZE   (1024 * 1024)
 
 #pragma warning(disable:4324)
 
@@ -39,8 +40,9 @@ typedef JerrorMgr * JerrorMgrPtr;
 typedef struct 
 {
    struct jpeg_destination_mgr pub;             /* public fields */
-   Gfile                      *outfile;         /* target stream */
-   JOCTET                     *buffer;          /* start of buffer */
+   Streamio                   *outfile;         /* target stream */
+   JOCTET                     *buffer;          /* start of buffer, pooled */
+   Gsize                       bufferSize;
 } JdestMgr;
 
 typedef JdestMgr * JdestMgrPtr;
@@ -48,8 +50,9 @@ typedef JdestMgr * JdestMgrPtr;
 typedef struct 
 {
    struct jpeg_source_mgr      pub;             /* public fields */
-   Gfile                      *infile;          /* source stream */
-   JOCTET                     *buffer;          /* start of buffer */
+   Streamio                   *infile;          /* source stream, NULL when all in memory */
+   JOCTET                     *buffer;          /* start of buffer, pooled */
+   Gsize                       bufferSize;
    boolean                     start_of_file;   /* have we gotten any data yet? */
 } JsrcMgr;
 
@@ -60,15 +63,85 @@ typedef struct
    struct jpeg_compress_struct    wcinfo;
    struct jpeg_decompress_struct  rcinfo;
    JerrorMgr                      jerr;
-   JSAMPARRAY                     buffer;     /* Output row buffer */
    Gi4                            row_stride; /* physical row width in output buffer */
    Gn1                           *btemp;
    JsrcMgr                       *jsrc;
    JdestMgr                      *jdest;
+   // Row table and the one slab the rows live in.  Reading, isRead once 
+   // the pixels are in them.
+   Gb                             isRead;
+   // Handed to libjpeg as the JSAMPARRAY so rows are read and written in 
+   // place.
    Gn1                          **row;
-   JSAMPROW                      *row_pointer;	
+   Gcount                         rowCapacity;
+   Gn1                           *rowSlab;
+   Gsize                          rowSlabSize;
+   // Streaming read.  Rows are decoded as they are asked for into a strip
+   // of rec_outbuf_height rows.  The strip holds rows stripIndex to 
+   // stripIndex + stripCount.  Going back turns streaming off for the file,
+   // it is decoded again from filePosition into the row table.
+   Gn1                          **strip;
+   Gcount                         stripCapacity;
+   Gn1                           *stripSlab;
+   Gsize                          stripSlabSize;
+   Gindex                         stripIndex;
+   Gcount                         stripCount;
+   Gb                             isStreamOff;
+   GfileIndex                     filePosition;
+   // A parallel decode was tried, or can't be done, for this file.
+   Gb                             isParallelOff;
+   // jpeg_create_decompress has been called.  Kept over gimgioReopen.
+   Gb                             isCreated;
+   // jpeg_start_decompress has been called.
+   Gb                             isDecompressing;
 } Jpgio;
 
+// One band of a parallel decode.  It is decoded as an image of its own, 
+// heightSrc high, made of the file header and restart segments segIndex to
+// segIndex + segCount.  Its output rows rowSkip to rowSkip + rowCount are 
+// image rows rowIndex on, the rest is overlap for the upsampling.
+typedef struct
+{
+   Gn1                        *header;          /* header with the height patched */
+   Gsize                       headerSize;
+   Gindex                      segIndex;
+   Gcount                      segCount;
+   Gcount                      heightSrc;
+   Gindex                      rowIndex;
+   Gcount                      rowSkip;
+   Gcount                      rowCount;
+   Gb                          isOk;
+} JpgBand;
+
+// What the bands of a parallel decode share.
+typedef struct
+{
+   Gimgio                     *img;
+   Jpgio                      *data;
+   Gn1 const                  *file;            /* the whole file */
+   Gsize                      *segStart;        /* entropy data of each restart segment */
+   Gsize                      *segEnd;
+   JpgBand                    *bandList;
+} JpgParallel;
+
+typedef struct 
+{
+   struct jpeg_source_mgr      pub;             /* public fields */
+   JpgParallel                *job;
+   JpgBand                    *band;
+   Gindex                      piece;           /* header, then each segment and its marker */
+   JOCTET                      marker[2];
+} JbandSrc;
+
+typedef JbandSrc * JbandSrcPtr;
+
+/******************************************************************************
+variable:
+******************************************************************************/
+// Handed to the decoder when the data runs out.  A memory source has no 
+// buffer to put it in.
+static JOCTET const _fakeEoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
 /******************************************************************************
 prototype:
 ******************************************************************************/
@@ -78,21 +151,34 @@ static void _JpgDestroyContent(  Gimgio * const img);
 static Gb   _JpgGetPixelRow(     Gimgio * const img, void *const pixel);
 
 static Gb   _JpgReadStart(       Gimgio * const img);
+static Gb   _JpgReset(           Gimgio * const img);
 
+static Gb   _JpgSetDecodeScale(  Gimgio * const img);
 static Gb   _JpgSetImageIndex(   Gimgio * const img, Gi4 const index);
 static Gb   _JpgSetPixelRow(     Gimgio * const img, void * const pixel);
 static Gb   _JpgSetTypeFile(     Gimgio * const img);
 
 // completely local
 static Gb   _CreateRowPointers(  Gimgio * const img, Jpgio * const data, Gi4 const rowSize);
+static Gb   _CreateStrip(        Gimgio * const img, Jpgio * const data);
 
+static void _DestroyDecompress(  Jpgio * const data);
 static void _DestroyRowPointers( Gimgio * const img, Jpgio * const data);
 
+static Gb   _ReadHeader(         Gimgio * const img, Jpgio * const data);
 static Gb   _ReadJpg(            Gimgio * const img, Jpgio * const data);
+static void _ReadJpgBand(        void * const job, Gindex const index);
+static Gb   _ReadJpgParallel(    Gimgio * const img, Jpgio * const data);
+static Gb   _ReadJpgStrip(       Gimgio * const img, Jpgio * const data);
+
+static void _SetOutputSize(      Gimgio * const img, Jpgio * const data);
 
 static Gb   _WriteJpg(           Gimgio * const img, Jpgio * const data);
 
 // jpeg stuff.
+static boolean _JbandSrcFillInputBuffer(j_decompress_ptr cinfo);
+static void    _JbandSrcStart(      j_decompress_ptr cinfo);
+
 static void    _JdestStart(         j_compress_ptr cinfo);
 static void    _JdestStop(          j_compress_ptr cinfo);
 static boolean _JdestSet(           j_compress_ptr cinfo);
@@ -119,13 +205,15 @@ Gb jpgioCreateContent(Gimgio * const img)
 
    genter;
 
-   data = gmemCreateType(Jpgio);
+   data = memioCreateType(img->memory, Jpgio);
    greturnFalseIf(!data);
 
    img->data           = data;
    img->DestroyContent = _JpgDestroyContent;
    img->GetPixelRow    = _JpgGetPixelRow;
    img->ReadStart      = _JpgReadStart;
+   img->Reset          = _JpgReset;
+   img->SetDecodeScale = _JpgSetDecodeScale;
    img->SetImageIndex  = _JpgSetImageIndex;
    img->SetPixelRow    = _JpgSetPixelRow;
    img->SetTypeFile    = _JpgSetTypeFile;
@@ -140,45 +228,147 @@ function:
 /******************************************************************************
 func: _CreateRowPointers
 
-Create the row pointers.
+Create the row pointers.  All rows live in one slab.  Each row is padded to 
+16 bytes so rows stay aligned for the row kernels.  An existing slab and row
+table are reused when they are big enough.
 ******************************************************************************/
 static Gb _CreateRowPointers(Gimgio * const img, Jpgio * const data, Gi4 const rowSize)
 {
-   Gi4 a;
+   Gi4   a;
+   Gsize rowSizePadded;
+
+   rowSizePadded = (rowSize + 15) & ~15;
+
+   // Allocate the 'row pointers'.
+   if (data->rowCapacity < img->height)
+   {
+      memioDestroyBuffer(img->memory, data->row);
+      data->rowCapacity = 0;
+
+      data->row = memioCreateTypeArray(img->memory, Gn1 *, img->height);
+      returnFalseIf(!data->row);
+
+      data->rowCapacity = img->height;
+   }
+
+   // Allocate the image buffer.
+   if (data->rowSlabSize < rowSizePadded * img->height)
+   {
+      memioDestroyBuffer(img->memory, data->rowSlab);
+      data->rowSlabSize = 0;
+
+      data->rowSlab = memioCreateTypeArray(img->memory, Gn1, rowSizePadded * img->height);
+      returnFalseIf(!data->rowSlab);
 
-   // Allocate the 'row pointers', image buffer.
-   data->row = memCreateTypeArray(Gn1 *, img->height);
-   returnFalseIf(!data->row);
+      data->rowSlabSize = rowSizePadded * img->height;
+   }
+   else
+   {
+      // Reused, start from a clean image like a new allocation would.
+      gmemClear(data->rowSlab, rowSizePadded * img->height);
+   }
 
-   // Allocate the rows.
-   forCount(a, img->height) 
+   // Point the rows into the slab.
+   forCount(a, img->height)
    {
-      data->row[a] = memCreateTypeArray(Gn1, rowSize);
-      returnFalseIf(!data->row[a]);
+      data->row[a] = &data->rowSlab[rowSizePadded * a];
    }
 
    return gbTRUE;
 }
 
 /******************************************************************************
-func: _DestroyRowPointers
+func: _CreateStrip
 
-Destroy the row pointers.
+Create the strip streaming reads decode into.  rec_outbuf_height rows is 
+what the decompressor gives at most in one call, it is only known once 
+decompression has started.  Reused when big enough.
 ******************************************************************************/
-static void _DestroyRowPointers(Gimgio * const img, Jpgio * const data)
+static Gb _CreateStrip(Gimgio * const img, Jpgio * const data)
 {
-   Gi4 a;
+   Gi4    a;
+   Gcount count;
+   Gsize  rowSizePadded;
+
+   count         = data->rcinfo.rec_outbuf_height;
+   rowSizePadded = (data->row_stride + 15) & ~15;
 
-   if (data->row)
+   if (data->stripCapacity < count)
    {
-      forCount(a, img->height)
-      {
-         memDestroy(data->row[a]);
-      }
+      memioDestroyBuffer(img->memory, data->strip);
+      data->stripCapacity = 0;
 
-      memDestroy(data->row);
+      data->strip = memioCreateTypeArray(img->memory, Gn1 *, count);
+      returnFalseIf(!data->strip);
+
+      data->stripCapacity = count;
+   }
+
+   if (data->stripSlabSize < rowSizePadded * count)
+   {
+      memioDestroyBuffer(img->memory, data->stripSlab);
+      data->stripSlabSize = 0;
+
+      data->stripSlab = memioCreateTypeArray(img->memory, Gn1, rowSizePadded * count);
+      returnFalseIf(!data->stripSlab);
+
+      data->stripSlabSize = rowSizePadded * count;
    }
-   data->row = NULL;
+
+   forCount(a, count)
+   {
+      data->strip[a] = &data->stripSlab[rowSizePadded * a];
+   }
+
+   data->stripIndex = 0;
+   data->stripCount = 0;
+
+   return gbTRUE;
+}
+
+/******************************************************************************
+func: _DestroyDecompress
+
+Destroy the decompressor and give the source buffer back.
+******************************************************************************/
+static void _DestroyDecompress(Jpgio * const data)
+{
+   if (data->jsrc)
+   {
+      memioDestroyBufferPooled(data->jsrc->buffer);
+      data->jsrc->buffer = NULL;
+   }
+
+   jpeg_destroy_decompress(&data->rcinfo);
+
+   // It lived in the decompressor's pool.
+   data->jsrc      = NULL;
+   data->isCreated = gbFALSE;
+}
+
+/******************************************************************************
+func: _DestroyRowPointers
+
+Destroy the row pointers and the strip.
+******************************************************************************/
+static void _DestroyRowPointers(Gimgio * const img, Jpgio * const data)
+{
+   memioDestroyBuffer(img->memory, data->row);
+   memioDestroyBuffer(img->memory, data->rowSlab);
+
+   data->row         = NULL;
+   data->rowCapacity = 0;
+   data->rowSlab     = NULL;
+   data->rowSlabSize = 0;
+
+   memioDestroyBuffer(img->memory, data->strip);
+   memioDestroyBuffer(img->memory, data->stripSlab);
+
+   data->strip         = NULL;
+   data->stripCapacity = 0;
+   data->stripSlab     = NULL;
+   data->stripSlabSize = 0;
+   data->stripCount    = 0;
 }
 
 /******************************************************************************
@@ -201,14 +391,20 @@ static void _JpgDestroyContent(Gimgio * const img)
 
       /* Step 7: Finish decompression */
 
-      jpeg_finish_decompress(&data->rcinfo);
-      /* We can ignore the greturn value since suspension is not possible
-      ** with the stdio data source. */
+      // Only when the image was actually read.  A header only open has 
+      // nothing to finish.
+      if (data->isDecompressing &&
+          data->rcinfo.output_scanline == data->rcinfo.output_height)
+      {
+         jpeg_finish_decompress(&data->rcinfo);
+         /* We can ignore the greturn value since suspension is not possible
+         ** with the stdio data source. */
+      }
 
       /* Step 8: Release JPEG decompression object */
 
       /* This is an important step since it will release a good deal of memory. */
-      jpeg_destroy_decompress(&data->rcinfo);
+      _DestroyDecompress(data);
 
       /* At this point you may want to check to see whether any corrupt-data
       ** warnings occurred (test whether jerr.pub.num_warnings is nonzero). */
@@ -222,43 +418,114 @@ static void _JpgDestroyContent(Gimgio * const img)
 _JpgDestroyContentERROR:
 
    _DestroyRowPointers(img, data);
-   gmemDestroy(img->data);
+   memioDestroyBuffer(img->memory, img->data);
    img->data = NULL;
 }
 
+/******************************************************************************
+func: _ReadHeader
+
+Read the header from where the source is and set up the decompression.  Call
+inside a setjmp.
+******************************************************************************/
+static Gb _ReadHeader(Gimgio * const img, Jpgio * const data)
+{
+   Gn1 const  *memory;
+   GfileIndex  count,
+               position;
+
+   data->jsrc->pub.init_source       = _JsrcStart;
+   data->jsrc->pub.fill_input_buffer = _JsrcFillInputBuffer;
+   data->jsrc->pub.skip_input_data   = _JsrcSkip;
+   data->jsrc->pub.resync_to_restart = jpeg_resync_to_restart;
+   data->jsrc->pub.term_source       = _JsrcStop;
+
+   // A file in memory, or mapped, is handed over whole.  The fill is then 
+   // only called at the end.
+   memory   = streamioGetMemory(img->stream, &count);
+   position = streamioGetPosition(img->stream);
+   if (memory &&
+       position <= count)
+   {
+      data->jsrc->pub.bytes_in_buffer = (size_t) (count - position);
+      data->jsrc->pub.next_input_byte = &memory[position];
+      data->jsrc->infile              = NULL;
+   }
+   else
+   {
+      if (!data->jsrc->buffer)
+      {
+         data->jsrc->bufferSize = streamioGetBufferSize();
+         data->jsrc->buffer     = (JOCTET *) memioCreateBufferPooled(data->jsrc->bufferSize);
+         returnFalseIf(!data->jsrc->buffer);
+      }
+
+      data->jsrc->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
+      data->jsrc->pub.next_input_byte = NULL; /* until buffer loaded */
+      data->jsrc->infile              = img->stream;
+   }
+
+   /* Step 3: read file parameters with jpeg_read_header() */
+   returnFalseIf(jpeg_read_header(&data->rcinfo, TRUE) != JPEG_HEADER_OK);
+
+   /* Step 4: set parameters for decompression */
+   data->rcinfo.dct_method           = JDCT_ISLOW;
+   data->rcinfo.out_color_components = 3;
+   data->rcinfo.out_color_space      = JCS_RGB;
+
+   /* Decompression is only started when the first row is asked for.  
+   ** The output dimensions are worked out without touching the image data
+   ** so opening a jpeg is cheap. */
+   _SetOutputSize(img, data);
+
+   return gbTRUE;
+}
+
 /******************************************************************************
 func: _ReadJpg
 
-Read in the image if not read already.
+Read in the whole image into the row table.  When streaming already got 
+partway the file is started over.
 ******************************************************************************/
 static Gb _ReadJpg(Gimgio * const img, Jpgio * const data)
 {
    // For PNG error handling. 
    gotoIf(setjmp(data->jerr.setjmp_buffer), _ReadJpgERROR);
 
+   if (data->isDecompressing)
+   {
+      jpeg_abort_decompress(&data->rcinfo);
+      data->isDecompressing = gbFALSE;
+
+      gotoIf(
+         !streamioSetPosition(img->stream, data->filePosition) ||
+         !_ReadHeader(img, data),
+         _ReadJpgERROR);
+   }
+
+   /* Step 5: Start decompressor */
+   jpeg_start_decompress(&data->rcinfo);
+   data->isDecompressing = gbTRUE;
+
+   data->row_stride = (int) (img->width * data->rcinfo.output_components);
 
    /* Failed to create image */
    gotoIf(!_CreateRowPointers(img, data, data->row_stride), _ReadJpgERROR);
 
    /* Here we use the library's state variable cinfo.output_scanline as the
-   ** loop counter, so that we don't have to keep track ourselves. */
+   ** loop counter, so that we don't have to keep track ourselves.  The 
+   ** library is given all the remaining rows of the row table and decodes 
+   ** straight into them, rec_outbuf_height rows a call.  Suspension is not
+   ** possible with our data source so it always makes progress. */
    while (data->rcinfo.output_scanline < data->rcinfo.output_height) 
    {
-      /* jpeg_read_scanlines expects an array of pointers to scanlines.
-      ** Here the array is only one element long, but you could ask for
-      ** more than one scanline at a time if that's more convenient. */
-      jpeg_read_scanlines(&data->rcinfo, data->buffer, 1);
-
-      /* Assume put_scanline_someplace wants a pointer and sample count. */
-      gmemCopyOverAt(
-         data->row[data->rcinfo.output_scanline - 1], 
-         data->row_stride,
-         0,
-         *data->buffer,
-         0);
+      jpeg_read_scanlines(
+         &data->rcinfo, 
+         (JSAMPARRAY) &data->row[data->rcinfo.output_scanline], 
+         data->rcinfo.output_height - data->rcinfo.output_scanline);
    }
 
-   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
+   data->isRead = gbTRUE;
 
    return gbTRUE;
 
@@ -269,6 +536,428 @@ _ReadJpgERROR:
    return gbFALSE;
 }
 
+/******************************************************************************
+func: _ReadJpgBand
+
+taskioRun job.  Decode one band of a parallel decode straight into its rows
+of the row table.  Overlap rows above go through a scratch strip, the rows
+below are only decoded as far as the upsampling of the last row needs.
+******************************************************************************/
+static void _ReadJpgBand(void * const job, Gindex const index)
+{
+   JpgParallel                   *par;
+   JpgBand                       *band;
+   Jpgio                         *data;
+   struct jpeg_decompress_struct  cinfo;
+   JerrorMgr                      jerr;
+   JbandSrc                       src;
+   // Freed after a longjmp so it has to be volatile.
+   JSAMPROW            * volatile scratch;
+   Gindex                         a;
+   JDIMENSION                     line,
+                                  count;
+
+   par     = (JpgParallel *) job;
+   band    = &par->bandList[index];
+   data    = par->data;
+   scratch = NULL;
+
+   band->isOk = gbFALSE;
+
+   cinfo.err           = jpeg_std_error(&jerr.pub);
+   jerr.pub.error_exit = _JerrorHandler;
+
+   gotoIf(setjmp(jerr.setjmp_buffer), _ReadJpgBandERROR);
+
+   jpeg_create_decompress(&cinfo);
+
+   gmemClear(&src, gsizeof(src));
+   src.pub.init_source       = _JbandSrcStart;
+   src.pub.fill_input_buffer = _JbandSrcFillInputBuffer;
+   src.pub.skip_input_data   = _JsrcSkip;
+   src.pub.resync_to_restart = jpeg_resync_to_restart;
+   src.pub.term_source       = _JsrcStop;
+   src.job                   = par;
+   src.band                  = band;
+   cinfo.src                 = &src.pub;
+
+   jpeg_read_header(&cinfo, TRUE);
+
+   // The same settings as the serial decode so the rows come out the same.
+   cinfo.dct_method           = data->rcinfo.dct_method;
+   cinfo.out_color_components = data->rcinfo.out_color_components;
+   cinfo.out_color_space      = data->rcinfo.out_color_space;
+   cinfo.scale_num            = data->rcinfo.scale_num;
+   cinfo.scale_denom          = data->rcinfo.scale_denom;
+   cinfo.do_fancy_upsampling  = data->rcinfo.do_fancy_upsampling;
+
+   jpeg_start_decompress(&cinfo);
+
+   scratch = (JSAMPROW *) memioCreateBuffer(
+      par->img->memory, 
+      cinfo.rec_outbuf_height * (gsizeof(JSAMPROW) + data->row_stride));
+   gotoIf(!scratch, _ReadJpgBandERROR);
+
+   forCount(a, cinfo.rec_outbuf_height)
+   {
+      scratch[a] = 
+         (JSAMPROW) &scratch[cinfo.rec_outbuf_height] + 
+         a * data->row_stride;
+   }
+
+   while (cinfo.output_scanline < (JDIMENSION) (band->rowSkip + band->rowCount))
+   {
+      line = cinfo.output_scanline;
+
+      if (line < (JDIMENSION) band->rowSkip)
+      {
+         count = gMIN((JDIMENSION) cinfo.rec_outbuf_height, band->rowSkip - line);
+         jpeg_read_scanlines(&cinfo, scratch, count);
+      }
+      else
+      {
+         jpeg_read_scanlines(
+            &cinfo, 
+            (JSAMPARRAY) &data->row[band->rowIndex + line - band->rowSkip], 
+            band->rowSkip + band->rowCount - line);
+      }
+   }
+
+   band->isOk = gbTRUE;
+
+_ReadJpgBandERROR:
+   memioDestroyBuffer(par->img->memory, scratch);
+   jpeg_destroy_decompress(&cinfo);
+}
+
+/******************************************************************************
+func: _ReadJpgParallel
+
+Decode the whole image into the row table on several threads.  The file has
+to be all in memory, it is read in when it isn't already there or mapped.  
+A baseline file with restart markers is made of segments that decode 
+without each other.  The image is cut into bands on rows where an MCU row 
+and a segment start together and each band is decoded as a small jpeg of 
+its own, the header with the height changed and its segments.  Bands 
+overlap by one cut so the upsampling at their edges sees the same rows the
+serial decode does.
+
+FALSE when the file doesn't allow it, or there is only one thread, and the 
+serial decode has to be used.  The decompressor and the source are left as
+they were.
+******************************************************************************/
+static Gb _ReadJpgParallel(Gimgio * const img, Jpgio * const data)
+{
+   Gb           result;
+   JpgParallel  par;
+   JpgBand     *band;
+   Gn1 const   *file,
+               *memory;
+   Gn1         *fileCopy,
+               *fileNew;
+   Gsize        fileSize,
+                fileCapacity,
+                sofPos,
+                sosEnd,
+                segmentSize,
+                at;
+   GfileIndex   position,
+                memoryCount;
+   Gcount       threadCount,
+                count,
+                mcuWidth,
+                mcuHeight,
+                mcuPerRow,
+                mcuRowCount,
+                unit,
+                unitRowCount,
+                unitSegCount,
+                unitCount,
+                segCount,
+                segCountFound,
+                bandCount,
+                a,
+                b;
+   Gindex       unitStart,
+                unitStop,
+                decodeStart,
+                decodeStop;
+
+   data->isParallelOff = gbTRUE;
+
+   threadCount = img->threadCount;
+   if (threadCount == 0)
+   {
+      threadCount = taskioGetCoreCount();
+   }
+
+   // Only one interleaved huffman scan with restart markers.
+   returnFalseIf(
+      threadCount <= 1                                         ||
+      data->rcinfo.progressive_mode                            ||
+      data->rcinfo.arith_code                                  ||
+      data->rcinfo.restart_interval == 0                       ||
+      data->rcinfo.comps_in_scan != data->rcinfo.num_components);
+
+   mcuWidth  = DCTSIZE;
+   mcuHeight = DCTSIZE;
+   if (data->rcinfo.num_components > 1)
+   {
+      mcuWidth  *= data->rcinfo.max_h_samp_factor;
+      mcuHeight *= data->rcinfo.max_v_samp_factor;
+   }
+   mcuPerRow   = (data->rcinfo.image_width  + mcuWidth  - 1) / mcuWidth;
+   mcuRowCount = (data->rcinfo.image_height + mcuHeight - 1) / mcuHeight;
+   segCount    = 
+      (mcuPerRow * mcuRowCount + data->rcinfo.restart_interval - 1) / 
+      data->rcinfo.restart_interval;
+
+   // Bands are cut every unit MCUs, where a row and a segment line up.
+   a = mcuPerRow;
+   b = data->rcinfo.restart_interval;
+   while (b)
+   {
+      count = a % b;
+      a     = b;
+      b     = count;
+   }
+   unit         = mcuPerRow / a * data->rcinfo.restart_interval;
+   unitRowCount = unit / mcuPerRow;
+   unitSegCount = unit / data->rcinfo.restart_interval;
+   unitCount    = (mcuRowCount + unitRowCount - 1) / unitRowCount;
+   returnFalseIf(unitCount < 2);
+
+   bandCount = gMIN(threadCount, unitCount);
+
+   result       = gbFALSE;
+   fileCopy     = NULL;
+   fileSize     = 0;
+   fileCapacity = FILE_BUF_SIZE;
+   gmemClear(&par, gsizeof(par));
+
+   position = streamioGetPosition(img->stream);
+
+   // Use the file where it is when it is in memory or mapped.
+   memory = streamioGetMemory(img->stream, &memoryCount);
+   if (memory &&
+       data->filePosition <= memoryCount)
+   {
+      file     = &memory[data->filePosition];
+      fileSize = (Gsize) (memoryCount - data->filePosition);
+   }
+   // Read in the whole file.  Where the source is now is restored after.
+   else
+   {
+      gotoIf(!streamioSetPosition(img->stream, data->filePosition), _ReadJpgParallelDONE);
+
+      fileCopy = memioCreateTypeArray(img->memory, Gn1, fileCapacity);
+      gotoIf(!fileCopy, _ReadJpgParallelDONE);
+
+      loop
+      {
+         if (fileSize == fileCapacity)
+         {
+            fileCapacity *= 2;
+            fileNew       = memioResizeBuffer(img->memory, fileCopy, fileCapacity);
+            gotoIf(!fileNew, _ReadJpgParallelDONE);
+            fileCopy      = fileNew;
+         }
+
+         count = streamioGet(img->stream, fileCapacity - fileSize, &fileCopy[fileSize]);
+         breakIf(count <= 0);
+
+         fileSize += count;
+      }
+
+      file = fileCopy;
+   }
+   par.file = file;
+
+   // Find the frame header and the end of the scan header.
+   sofPos = 0;
+   sosEnd = 0;
+   at     = 2;
+   loop
+   {
+      gotoIf(at + 4 > fileSize || file[at] != 0xFF, _ReadJpgParallelDONE);
+
+      // Fill bytes.
+      if (file[at + 1] == 0xFF)
+      {
+         at++;
+         continue;
+      }
+
+      segmentSize = ((Gsize) file[at + 2] << 8) | file[at + 3];
+
+      // Start of scan.
+      if (file[at + 1] == 0xDA)
+      {
+         sosEnd = at + 2 + segmentSize;
+         break;
+      }
+      // Baseline or extended sequential frame.
+      if (file[at + 1] == 0xC0 ||
+          file[at + 1] == 0xC1)
+      {
+         sofPos = at;
+      }
+
+      at += 2 + segmentSize;
+   }
+   gotoIf(!sofPos || sosEnd > fileSize, _ReadJpgParallelDONE);
+
+   // Find the restart segments.  Anything other than the end of the image 
+   // after them means more scans, or something we don't understand.
+   par.segStart = memioCreateTypeArray(img->memory, Gsize, segCount);
+   par.segEnd   = memioCreateTypeArray(img->memory, Gsize, segCount);
+   gotoIf(!par.segStart || !par.segEnd, _ReadJpgParallelDONE);
+
+   segCountFound   = 0;
+   par.segStart[0] = sosEnd;
+   for (at = sosEnd; at + 1 < fileSize; at++)
+   {
+      continueIf(file[at] != 0xFF);
+
+      // Stuffed zero or fill byte.
+      continueIf(
+         file[at + 1] == 0x00 || 
+         file[at + 1] == 0xFF);
+
+      if (file[at + 1] >= JPEG_RST0 &&
+          file[at + 1] <= JPEG_RST0 + 7)
+      {
+         gotoIf(segCountFound + 1 >= segCount, _ReadJpgParallelDONE);
+
+         par.segEnd[  segCountFound]     = at;
+         par.segStart[segCountFound + 1] = at + 2;
+         segCountFound++;
+         at++;
+         continue;
+      }
+
+      gotoIf(file[at + 1] != JPEG_EOI, _ReadJpgParallelDONE);
+
+      par.segEnd[segCountFound] = at;
+      segCountFound++;
+      break;
+   }
+   gotoIf(segCountFound != segCount, _ReadJpgParallelDONE);
+
+   // Lay out the bands.
+   data->row_stride = (int) (img->width * data->rcinfo.output_components);
+   gotoIf(!_CreateRowPointers(img, data, data->row_stride), _ReadJpgParallelDONE);
+
+   par.img      = img;
+   par.data     = data;
+   par.bandList = memioCreateTypeArray(img->memory, JpgBand, bandCount);
+   gotoIf(!par.bandList, _ReadJpgParallelDONE);
+
+   forCount(a, bandCount)
+   {
+      band = &par.bandList[a];
+
+      unitStart   = (Gindex) (((Gi8) a       * unitCount) / bandCount);
+      unitStop    = (Gindex) (((Gi8) (a + 1) * unitCount) / bandCount);
+      decodeStart = gMAX(unitStart - 1, 0);
+      decodeStop  = gMIN(unitStop  + 1, unitCount);
+
+      band->segIndex  = decodeStart * unitSegCount;
+      band->segCount  = gMIN(decodeStop * unitSegCount, segCount) - band->segIndex;
+      band->heightSrc = 
+         gMIN(decodeStop * unitRowCount * mcuHeight, (Gcount) data->rcinfo.image_height) - 
+         decodeStart * unitRowCount * mcuHeight;
+
+      // MCU heights are a multiple of 8 so the rows scale exactly.
+      band->rowIndex  = unitStart * unitRowCount * mcuHeight / img->decodeScale;
+      band->rowSkip   = (unitStart - decodeStart) * unitRowCount * mcuHeight / img->decodeScale;
+      band->rowCount  = 
+         gMIN(unitStop * unitRowCount * mcuHeight / img->decodeScale, img->height) - 
+         band->rowIndex;
+
+      band->headerSize = sosEnd;
+      band->header     = memioCreateTypeArray(img->memory, Gn1, sosEnd);
+      gotoIf(!band->header, _ReadJpgParallelDONE);
+
+      gmemCopyOverAt(band->header, sosEnd, 0, file, 0);
+      band->header[sofPos + 5] = (Gn1) (band->heightSrc >> 8);
+      band->header[sofPos + 6] = (Gn1) (band->heightSrc & 0xFF);
+   }
+
+   gotoIf(!taskioRun(threadCount, bandCount, _ReadJpgBand, &par), _ReadJpgParallelDONE);
+
+   result = gbTRUE;
+   forCount(a, bandCount)
+   {
+      result = result && par.bandList[a].isOk;
+   }
+
+_ReadJpgParallelDONE:
+   if (par.bandList)
+   {
+      forCount(a, bandCount)
+      {
+         memioDestroyBuffer(img->memory, par.bandList[a].header);
+      }
+   }
+   memioDestroyBuffer(img->memory, par.bandList);
+   memioDestroyBuffer(img->memory, par.segStart);
+   memioDestroyBuffer(img->memory, par.segEnd);
+   memioDestroyBuffer(img->memory, fileCopy);
+
+   // The serial decode carries on from where it was if this failed.  The 
+   // source could go back to filePosition so it can come back here.
+   streamioSetPosition(img->stream, position);
+
+   data->isRead = result;
+
+   return result;
+}
+
+/******************************************************************************
+func: _ReadJpgStrip
+
+Decode forward until img->row is in the strip.  Only rec_outbuf_height rows
+are ever held here, the rest of the buffering is the decompressor's own 
+iMCU row.
+******************************************************************************/
+static Gb _ReadJpgStrip(Gimgio * const img, Jpgio * const data)
+{
+   gotoIf(setjmp(data->jerr.setjmp_buffer), _ReadJpgStripERROR);
+
+   if (!data->isDecompressing)
+   {
+      /* Step 5: Start decompressor */
+      jpeg_start_decompress(&data->rcinfo);
+      data->isDecompressing = gbTRUE;
+
+      data->row_stride = (int) (img->width * data->rcinfo.output_components);
+
+      gotoIf(!_CreateStrip(img, data), _ReadJpgStripERROR);
+   }
+
+   // Rows skipped over are decoded into the strip and dropped.
+   while (img->row >= data->stripIndex + data->stripCount)
+   {
+      gotoIf(
+         data->rcinfo.output_scanline >= data->rcinfo.output_height, 
+         _ReadJpgStripERROR);
+
+      data->stripIndex = data->rcinfo.output_scanline;
+      data->stripCount = jpeg_read_scanlines(
+         &data->rcinfo, 
+         (JSAMPARRAY) data->strip, 
+         (JDIMENSION) data->stripCapacity);
+   }
+
+   return gbTRUE;
+
+_ReadJpgStripERROR:
+   data->stripCount = 0;
+
+   return gbFALSE;
+}
+
 /******************************************************************************
 func: _JpgGetPixelRow
 
@@ -280,9 +969,35 @@ static Gb _JpgGetPixelRow(Gimgio * const img, void * const pixel)
 
    data = (Jpgio *) img->data;
 
-   // Read in the png file.
-   if (!data->row)
+   // Try all the cores on the whole image first.
+   if (!data->isRead          &&
+       !data->isParallelOff   &&
+       !data->isDecompressing)
+   {
+      _ReadJpgParallel(img, data);
+   }
+
+   // Rows in order come straight off the decompressor.
+   if (!data->isRead      &&
+       !data->isStreamOff &&
+       img->row >= data->stripIndex)
+   {
+      returnFalseIf(!_ReadJpgStrip(img, data));
+
+      gimgioConvert(
+         img->width,
+         img->typeFile,
+         data->strip[img->row - data->stripIndex],
+         img->typePixel,
+         pixel);
+
+      return gbTRUE;
+   }
+
+   // Went back.  Read in the whole jpeg file.
+   if (!data->isRead)
    {
+      data->isStreamOff = gbTRUE;
       returnFalseIf(!_ReadJpg(img, data));
    }
 
@@ -319,69 +1034,108 @@ static Gb _JpgReadStart(Gimgio * const img)
    /* Establish the setjmp greturn context for my_error_exit to use. */
    gotoIf(setjmp(data->jerr.setjmp_buffer), _JpgReadStartERROR);
 
-   /* Now we can initialize the JPEG decompression object. */
-   jpeg_create_decompress(&data->rcinfo);
+   // A reopen keeps the decompressor and the source from the last file.
+   if (!data->isCreated)
+   {
+      /* Now we can initialize the JPEG decompression object. */
+      jpeg_create_decompress(&data->rcinfo);
+      data->isCreated = gbTRUE;
+
+      /* Step 2: specify data source (eg, a file) */
+      data->rcinfo.src = (struct jpeg_source_mgr *) 
+         (*data->rcinfo.mem->alloc_small)(
+            (j_common_ptr) &data->rcinfo, 
+            JPOOL_PERMANENT,
+            sizeof(JsrcMgr));
+
+      data->jsrc = (JsrcMgrPtr) data->rcinfo.src;
+
+      // The pool doesn't clear.  The buffer is only made when needed.
+      data->jsrc->buffer     = NULL;
+      data->jsrc->bufferSize = 0;
+   }
 
-   /* Step 2: specify data source (eg, a file) */
-   data->rcinfo.src = (struct jpeg_source_mgr *) 
-      (*data->rcinfo.mem->alloc_small)(
-         (j_common_ptr) &data->rcinfo, 
-         JPOOL_PERMANENT,
-         sizeof(JsrcMgr));
+   // Where to start over from if the caller goes back after streaming.
+   data->filePosition = streamioGetPosition(img->stream);
 
-   data->jsrc = (JsrcMgrPtr) data->rcinfo.src;
-   
-   data->jsrc->buffer = (JOCTET *) 
-      (*data->rcinfo.mem->alloc_small)(
-         (j_common_ptr) &data->rcinfo, 
-         JPOOL_PERMANENT,
-         BUF_SIZE * sizeof(JOCTET));
+   gotoIf(!_ReadHeader(img, data), _JpgReadStartERROR);
 
-   data->jsrc->pub.init_source       = _JsrcStart;
-   data->jsrc->pub.fill_input_buffer = _JsrcFillInputBuffer;
-   data->jsrc->pub.skip_input_data   = _JsrcSkip;
-   data->jsrc->pub.resync_to_restart = jpeg_resync_to_restart;
-   data->jsrc->pub.term_source       = _JsrcStop;
-   data->jsrc->pub.bytes_in_buffer   = 0; /* forces fill_input_buffer on first read */
-   data->jsrc->pub.next_input_byte   = NULL; /* until buffer loaded */
-   data->jsrc->infile                = img->file;
+   img->typeFile   = gimgioTypeRGB | gimgioTypeN1;
+   img->imageCount = 1;
 
-   /* Step 3: read file parameters with jpeg_read_header() */
-   jpeg_read_header(&data->rcinfo, TRUE);
+   return gbTRUE;
 
-   /* Step 4: set parameters for decompression */
-   data->rcinfo.dct_method           = JDCT_ISLOW;
-   data->rcinfo.out_color_components = 3;
-   data->rcinfo.out_color_space      = JCS_RGB;
+_JpgReadStartERROR:
+   /* If we get here, the JPEG code has signaled an error.
+   ** We need to clean up the JPEG object, close the input file, and greturn. */
+   _DestroyDecompress(data);
 
-   /* Step 5: Start decompressor */
-   jpeg_start_decompress(&data->rcinfo);
+   return gbFALSE;
+}
 
-   /* We can ignore the greturn value since suspension is not possible
-   ** with the stdio data source. */
+/******************************************************************************
+func: _JpgReset
 
-   /* We may need to do some setup of our own at this point before reading
-   ** the data.  After jpeg_start_decompress() we have the correct scaled
-   ** output image dimensions available, as well as the output colormap
-   ** if we asked for color quantization.
-   ** In this example, we need to make an output work buffer of the right size. */ 
-   /* JSAMPLEs per row in output buffer */
-   img->width  = data->rcinfo.output_width;
-   img->height = data->rcinfo.output_height;
+Ready for the next file.  jpeg_abort_decompress drops the image but keeps 
+the decompressor and its source for the next jpeg_read_header.  The row 
+table, strip and slabs are kept too.
+******************************************************************************/
+static Gb _JpgReset(Gimgio * const img)
+{
+   // no genter and greturn because of setjmp.
 
-   data->row_stride = (int) (img->width * data->rcinfo.output_components);
+   Jpgio *data;
+
+   data = (Jpgio *) img->data;
+
+   data->isRead          = gbFALSE;
+   data->isDecompressing = gbFALSE;
+   data->isStreamOff     = gbFALSE;
+   data->isParallelOff   = gbFALSE;
+   data->stripIndex      = 0;
+   data->stripCount      = 0;
+
+   if (!data->isCreated)
+   {
+      return gbTRUE;
+   }
 
-   /* Make a one-row-high sample array that will go away when done with image */
-   data->buffer = (*data->rcinfo.mem->alloc_sarray)
-      ((j_common_ptr) &data->rcinfo, JPOOL_IMAGE, data->row_stride, 1);
+   gotoIf(setjmp(data->jerr.setjmp_buffer), _JpgResetERROR);
+
+   jpeg_abort_decompress(&data->rcinfo);
 
    return gbTRUE;
 
-_JpgReadStartERROR:
-   /* If we get here, the JPEG code has signaled an error.
-   ** We need to clean up the JPEG object, close the input file, and greturn. */
-   jpeg_destroy_decompress(&data->rcinfo);
+_JpgResetERROR:
+   _DestroyDecompress(data);
 
+   return gbTRUE;
+}
+
+/******************************************************************************
+func: _JpgSetDecodeScale
+
+Change the output size.  Only until decompression has started.
+******************************************************************************/
+static Gb _JpgSetDecodeScale(Gimgio * const img)
+{
+   // no genter and greturn because of setjmp.
+
+   Jpgio *data;
+
+   data = (Jpgio *) img->data;
+
+   returnFalseIf(
+      !data->isCreated ||
+      data->isDecompressing);
+
+   gotoIf(setjmp(data->jerr.setjmp_buffer), _JpgSetDecodeScaleERROR);
+
+   _SetOutputSize(img, data);
+
+   return gbTRUE;
+
+_JpgSetDecodeScaleERROR:
    return gbFALSE;
 }
 
@@ -442,6 +1196,26 @@ static Gb _JpgSetTypeFile(Gimgio * const img)
    return result;
 }
 
+/******************************************************************************
+func: _SetOutputSize
+
+Have libjpeg reduce by img->decodeScale in the IDCT.  
+jpeg_calc_output_dimensions gives the size without decoding anything.  
+Reduced images are thumbnails that get resampled anyway so the smooth chroma
+upsampling isn't worth its time there.  Call inside a setjmp.
+******************************************************************************/
+static void _SetOutputSize(Gimgio * const img, Jpgio * const data)
+{
+   data->rcinfo.scale_num           = 1;
+   data->rcinfo.scale_denom         = (unsigned int) img->decodeScale;
+   data->rcinfo.do_fancy_upsampling = (boolean) (img->decodeScale == 1);
+
+   jpeg_calc_output_dimensions(&data->rcinfo);
+
+   img->width  = data->rcinfo.output_width;
+   img->height = data->rcinfo.output_height;
+}
+
 /******************************************************************************
 func: _WriteJpg
 
@@ -478,7 +1252,10 @@ static Gb _WriteJpg(Gimgio * const img, Jpgio * const data)
    data->jdest->pub.init_destination    = _JdestStart;
    data->jdest->pub.empty_output_buffer = _JdestSet;
    data->jdest->pub.term_destination    = _JdestStop;
-   data->jdest->outfile                 = img->file;
+   data->jdest->outfile                 = img->stream;
+   data->jdest->bufferSize              = streamioGetBufferSize();
+   data->jdest->buffer                  = (JOCTET *) memioCreateBufferPooled(data->jdest->bufferSize);
+   gotoIf(!data->jdest->buffer, _WriteJpgERROR);
 
    /* Step 3: set parameters for compression */
 
@@ -496,10 +1273,11 @@ static Gb _WriteJpg(Gimgio * const img, Jpgio * const data)
    jpeg_set_defaults(&data->wcinfo);
 
    /* Now you can set any non-default parameters you wish to.
-   ** Here we just illustrate the use of quality (quantization table) scaling: */
+   ** Here we just illustrate the use of quality (quantization table) scaling.
+   ** Until the compression is set the quality is full, as it always was. */
    jpeg_set_quality(
       &data->wcinfo, 
-      (int) (255. * (-img->compression + 1.)),
+      img->isCompressionSet ? (int) (255. * (-img->compression + 1.)) : 255,
       TRUE);
 
    /* Step 4: Start compressor */
@@ -512,18 +1290,17 @@ static Gb _WriteJpg(Gimgio * const img, Jpgio * const data)
    /*           jpeg_write_scanlines(...); */
 
    /* Here we use the library's state variable cinfo.next_scanline as the
-   ** loop counter, so that we don't have to keep track ourselves.
-   ** To keep things simple, we pass one scanline per call; you can pass
-   ** more if you wish, though. */
+   ** loop counter, so that we don't have to keep track ourselves.  The 
+   ** row table is passed as is so the library reads the rows in place and
+   ** takes as many as it can each call. */
    data->row_stride = (int) (img->width * 3); /* JSAMPLEs per row in image_buffer */
 
    while (data->wcinfo.next_scanline < data->wcinfo.image_height) 
    {
-      /* jpeg_write_scanlines expects an array of pointers to scanlines.
-      ** Here the array is only one element long, but you could pass
-      ** more than one scanline at a time if that's more convenient. */
-      data->row_pointer = (JSAMPROW *) &data->row[data->wcinfo.next_scanline];
-      jpeg_write_scanlines(&data->wcinfo, data->row_pointer, 1);
+      jpeg_write_scanlines(
+         &data->wcinfo, 
+         (JSAMPARRAY) &data->row[data->wcinfo.next_scanline], 
+         data->wcinfo.image_height - data->wcinfo.next_scanline);
    }
 
    /* Step 6: Finish compression */
@@ -533,7 +1310,9 @@ static Gb _WriteJpg(Gimgio * const img, Jpgio * const data)
    /* Step 7: release JPEG compression object */
 
    /* This is an important step since it will release a good deal of memory. */
+   memioDestroyBufferPooled(data->jdest->buffer);
    jpeg_destroy_compress(&data->wcinfo);
+   data->jdest = NULL;
 
    return gbTRUE;
 
@@ -542,12 +1321,81 @@ _WriteJpgERROR:
 
    /* If we get here, the JPEG code has signaled an error.
    ** We need to clean up the JPEG object, close the input file, and greturn. */
+   if (data->jdest)
+   {
+      memioDestroyBufferPooled(data->jdest->buffer);
+   }
    jpeg_destroy_compress(&data->wcinfo);
+   data->jdest = NULL;
 
    return gbFALSE;
 }
 
 
+/******************************************************************************
+func: _JbandSrcStart _JbandSrcFillInputBuffer
+
+Source of one band of a parallel decode.  It hands out the band's header, 
+then the entropy data of each of its segments straight from the file, each
+followed by a restart marker numbered from RST0 again, and the end of image
+after the last.
+******************************************************************************/
+void _JbandSrcStart(j_decompress_ptr cinfo)
+{
+   JbandSrcPtr src = (JbandSrcPtr) cinfo->src;
+
+   src->piece               = 0;
+   src->pub.bytes_in_buffer = 0;
+   src->pub.next_input_byte = NULL;
+}
+
+boolean _JbandSrcFillInputBuffer(j_decompress_ptr cinfo)
+{
+   JbandSrcPtr  src = (JbandSrcPtr) cinfo->src;
+   Gindex       piece,
+                seg;
+
+   do
+   {
+      piece = src->piece++;
+      seg   = (piece - 1) / 2;
+
+      if (piece == 0)
+      {
+         src->pub.next_input_byte = src->band->header;
+         src->pub.bytes_in_buffer = src->band->headerSize;
+      }
+      else if (seg >= src->band->segCount)
+      {
+         /* Decoder wants more than there is.  Insert a fake EOI marker */
+         WARNMS(cinfo, JWRN_JPEG_EOF);
+
+         src->marker[0]           = (JOCTET) 0xFF;
+         src->marker[1]           = (JOCTET) JPEG_EOI;
+         src->pub.next_input_byte = src->marker;
+         src->pub.bytes_in_buffer = 2;
+      }
+      else if (piece % 2)
+      {
+         src->pub.next_input_byte = 
+            &src->job->file[src->job->segStart[src->band->segIndex + seg]];
+         src->pub.bytes_in_buffer = 
+            src->job->segEnd[  src->band->segIndex + seg] - 
+            src->job->segStart[src->band->segIndex + seg];
+      }
+      else
+      {
+         src->marker[0]           = (JOCTET) 0xFF;
+         src->marker[1]           = (JOCTET) 
+            ((seg == src->band->segCount - 1) ? JPEG_EOI : JPEG_RST0 + (seg & 7));
+         src->pub.next_input_byte = src->marker;
+         src->pub.bytes_in_buffer = 2;
+      }
+   } while (src->pub.bytes_in_buffer == 0);
+
+   return TRUE;
+}
+
 /******************************************************************************
 func: _JdestStart, _JdestStop, _JdestSet
 
@@ -557,25 +1405,20 @@ void _JdestStart(j_compress_ptr cinfo)
 {
    JdestMgrPtr dest = (JdestMgrPtr) cinfo->dest;
 
-   /* Allocate the output buffer --- it will be released when done with image */
-   dest->buffer = (JOCTET *)(*cinfo->mem->alloc_small)(
-      (j_common_ptr) cinfo, 
-      JPOOL_IMAGE,
-      BUF_SIZE * sizeof(JOCTET));
-
+   /* The output buffer comes from _WriteJpg. */
    dest->pub.next_output_byte = dest->buffer;
-   dest->pub.free_in_buffer   = BUF_SIZE;
+   dest->pub.free_in_buffer   = dest->bufferSize;
 }
 
 void _JdestStop(j_compress_ptr cinfo) 
 {
    JdestMgrPtr dest      = (JdestMgrPtr) cinfo->dest;
-   int         datacount = (int) (BUF_SIZE - dest->pub.free_in_buffer);
+   int         datacount = (int) (dest->bufferSize - dest->pub.free_in_buffer);
 
    /* Write any data remaining in the buffer */
    if (datacount > 0) 
    {
-      if (!gfileSet((Gfile *) dest->outfile, datacount, dest->buffer, NULL)) 
+      if (!streamioSet(dest->outfile, datacount, dest->buffer)) 
       {
          ERREXIT(cinfo, JERR_FILE_WRITE);
       }
@@ -586,13 +1429,13 @@ boolean _JdestSet(j_compress_ptr cinfo)
 {
    JdestMgrPtr dest = (JdestMgrPtr) cinfo->dest;
 
-   if (!gfileSet((Gfile *) dest->outfile, BUF_SIZE, dest->buffer, NULL)) 
+   if (!streamioSet(dest->outfile, (Gcount) dest->bufferSize, dest->buffer)) 
    {
       ERREXIT(cinfo, JERR_FILE_WRITE);
    }
 
    dest->pub.next_output_byte = dest->buffer;
-   dest->pub.free_in_buffer   = BUF_SIZE;
+   dest->pub.free_in_buffer   = dest->bufferSize;
 
    return TRUE;
 }
@@ -618,7 +1461,8 @@ void _JerrorHandler(j_common_ptr cinfo)
 /******************************************************************************
 func: _JsrcStart _JsrcFillInputBuffer _JsrcSkip _JsrcStop
 
-Decompression file access functions.
+Decompression file access functions.  _JsrcSkip and _JsrcStop serve the 
+band sources too.
 ******************************************************************************/
 void _JsrcStart(j_decompress_ptr cinfo) 
 {
@@ -635,12 +1479,18 @@ boolean _JsrcFillInputBuffer(j_decompress_ptr cinfo)
    JsrcMgrPtr src = (JsrcMgrPtr) cinfo->src;
    size_t     nbytes;
 
-   nbytes = (size_t) gfileGet((Gfile *) src->infile, BUF_SIZE, src->buffer);
+   nbytes = 0;
+   if (src->infile)
+   {
+      nbytes = (size_t) streamioGet(src->infile, (Gcount) src->bufferSize, src->buffer);
+   }
 
    if (nbytes <= 0) 
    {
-      /* Treat empty input file as fatal error */
-      if (src->start_of_file) 
+      /* Treat empty input file as fatal error.  From memory the data was 
+      ** all there from the start. */
+      if (src->start_of_file &&
+          src->infile) 
       {
          ERREXIT(cinfo, JERR_INPUT_EMPTY);
       }
@@ -648,9 +1498,11 @@ boolean _JsrcFillInputBuffer(j_decompress_ptr cinfo)
       WARNMS(cinfo, JWRN_JPEG_EOF);
 
       /* Insert a fake EOI marker */
-      src->buffer[0] = (JOCTET) 0xFF;
-      src->buffer[1] = (JOCTET) JPEG_EOI;
-      nbytes         = 2;
+      src->pub.next_input_byte = _fakeEoi;
+      src->pub.bytes_in_buffer = 2;
+      src->start_of_file       = FALSE;
+
+      return TRUE;
    }
 
    src->pub.next_input_byte = src->buffer;
@@ -673,7 +1525,7 @@ void _JsrcSkip(j_decompress_ptr cinfo, long num_bytes)
       {
          num_bytes -= (long) src->pub.bytes_in_buffer;
          
-         _JsrcFillInputBuffer(cinfo);
+         (*src->pub.fill_input_buffer)(cinfo);
          /* note we assume that fill_input_buffer will never greturn FALSE,
          ** so suspension need not be handled. */
       }
@@ -0,0 +1,235 @@
+/******************************************************************************
+
+file:       mapio.c
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Read only memory mapped files.  The whole file is mapped.  Reading a row is
+then just a pointer into the mapping and the OS page cache does the rest.
+
+******************************************************************************/
+
+/******************************************************************************
+include:
+******************************************************************************/
+#include "precompiled.h"
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+/******************************************************************************
+local:
+type:
+******************************************************************************/
+struct Mapio
+{
+#if defined(_WIN32)
+   HANDLE       file;
+   HANDLE       mapping;
+#else
+   int          file;
+#endif
+   Gn1         *buffer;
+   Gi8          count;
+   MapioAdvice  advice;
+};
+
+/******************************************************************************
+global: to library only
+function:
+******************************************************************************/
+/******************************************************************************
+func: mapioCreate
+
+Map the file read only.  NULL if the file can not be mapped.  Empty files can
+not be mapped.
+******************************************************************************/
+Mapio *mapioCreate(Gpath const * const path)
+{
+   genter;
+
+   Char  *name;
+   Mapio *map;
+
+   greturnNullIf(!path);
+
+   map = gmemCreateType(Mapio);
+   greturnNullIf(!map);
+
+#if !defined(_WIN32)
+   map->file = -1;
+#endif
+
+   name = gsCreateA(path);
+
+   breakScope
+   {
+      breakIf(!name);
+
+#if defined(_WIN32)
+      {
+         LARGE_INTEGER size;
+
+         map->file = CreateFileA(
+            name, 
+            GENERIC_READ, 
+            FILE_SHARE_READ, 
+            NULL, 
+            OPEN_EXISTING, 
+            FILE_ATTRIBUTE_NORMAL, 
+            NULL);
+         breakIf(map->file == INVALID_HANDLE_VALUE);
+
+         breakIf(!GetFileSizeEx(map->file, &size));
+         map->count = (Gi8) size.QuadPart;
+         breakIf(map->count <= 0);
+
+         // Can't map more than the address space.
+         breakIf((Gi8) (size_t) map->count != map->count);
+
+         map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+         breakIf(!map->mapping);
+
+         map->buffer = (Gn1 *) MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+         breakIf(!map->buffer);
+      }
+#else
+      {
+         struct stat info;
+         void       *buffer;
+
+         map->file = open(name, O_RDONLY);
+         breakIf(map->file < 0);
+
+         breakIf(fstat(map->file, &info) != 0);
+         map->count = (Gi8) info.st_size;
+         breakIf(map->count <= 0);
+
+         // Can't map more than the address space.
+         breakIf((Gi8) (size_t) map->count != map->count);
+
+         buffer = mmap(NULL, (size_t) map->count, PROT_READ, MAP_PRIVATE, map->file, 0);
+         breakIf(buffer == MAP_FAILED);
+
+         map->buffer = (Gn1 *) buffer;
+      }
+#endif
+
+      gmemDestroy(name);
+
+      map->advice = mapioAdviceNORMAL;
+
+      greturn map;
+   }
+
+   // Clean up.
+   gmemDestroy(name);
+#if defined(_WIN32)
+   if (map->mapping)
+   {
+      CloseHandle(map->mapping);
+   }
+   if (map->file && 
+       map->file != INVALID_HANDLE_VALUE)
+   {
+      CloseHandle(map->file);
+   }
+#else
+   if (map->file >= 0)
+   {
+      close(map->file);
+   }
+#endif
+   gmemDestroy(map);
+
+   greturn NULL;
+}
+
+/******************************************************************************
+func: mapioDestroy
+
+Unmap and close the file.
+******************************************************************************/
+void mapioDestroy(Mapio * const map)
+{
+   genter;
+
+   greturnVoidIf(!map);
+
+#if defined(_WIN32)
+   UnmapViewOfFile(map->buffer);
+   CloseHandle(map->mapping);
+   CloseHandle(map->file);
+#else
+   munmap(map->buffer, (size_t) map->count);
+   close(map->file);
+#endif
+
+   gmemDestroy(map);
+
+   greturn;
+}
+
+/******************************************************************************
+func: mapioGetBuffer
+
+Get the start of the mapped file.
+******************************************************************************/
+Gn1 const *mapioGetBuffer(Mapio const * const map)
+{
+   genter;
+
+   greturnNullIf(!map);
+
+   greturn map->buffer;
+}
+
+/******************************************************************************
+func: mapioGetCount
+
+Get the byte count of the mapped file.
+******************************************************************************/
+Gi8 mapioGetCount(Mapio const * const map)
+{
+   genter;
+
+   greturnIf(!map, 0);
+
+   greturn map->count;
+}
+
+/******************************************************************************
+func: mapioSetAdvice
+
+Tell the OS how the mapping will be read so read ahead can be tuned.  Only a
+hint.  Windows has no equivalent for a whole mapping so it is ignored there.
+******************************************************************************/
+void mapioSetAdvice(Mapio * const map, MapioAdvice const advice)
+{
+   genter;
+
+   greturnVoidIf(
+      !map ||
+      map->advice == advice);
+
+   map->advice = advice;
+
+#if !defined(_WIN32)
+   switch (advice)
+   {
+   case mapioAdviceNORMAL:     madvise(map->buffer, (size_t) map->count, MADV_NORMAL);     break;
+   case mapioAdviceSEQUENTIAL: madvise(map->buffer, (size_t) map->count, MADV_SEQUENTIAL); break;
+   case mapioAdviceRANDOM:     madvise(map->buffer, (size_t) map->count, MADV_RANDOM);     break;
+   }
+#endif
+
+   greturn;
+}
@@ -0,0 +1,37 @@
+/******************************************************************************
+
+file:       mapio.h
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Read only memory mapped files.
+
+******************************************************************************/
+
+/******************************************************************************
+constant:
+******************************************************************************/
+typedef enum
+{
+   mapioAdviceNORMAL,
+   mapioAdviceSEQUENTIAL,
+   mapioAdviceRANDOM
+} MapioAdvice;
+
+/******************************************************************************
+type:
+******************************************************************************/
+typedef struct Mapio Mapio;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+Mapio     *mapioCreate(     Gpath const * const path);
+
+void       mapioDestroy(    Mapio * const map);
+
+Gn1 const *mapioGetBuffer(  Mapio const * const map);
+Gi8        mapioGetCount(   Mapio const * const map);
+
+void       mapioSetAdvice(  Mapio * const map, MapioAdvice const advice);
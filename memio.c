@@ -0,0 +1,503 @@
+/******************************************************************************
+
+file:       memio.c
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Memory for the codecs.  Every buffer has a small header with its size so 
+buffers can be resized and arena buffers can be handed out without the 
+allocator knowing about them.
+
+A Memio is the memory of one image.  NULL for a Memio goes straight to the
+allocator.  In arena mode buffers come out of large blocks and are only 
+given back when the Memio is destroyed.
+
+IO buffers are pooled.  They outlive the image that used them so the next 
+image doesn't have to allocate them again.  The pool is emptied when the 
+allocator changes and at memioStop.
+
+******************************************************************************/
+
+/******************************************************************************
+include:
+******************************************************************************/
+#include "precompiled.h"
+
+#include <stdint.h>
+
+/******************************************************************************
+local:
+constant:
+******************************************************************************/
+// Every buffer starts on a multiple of this whatever the allocator hands 
+// back, so the slab rows are aligned for the row kernels.
+#define memioALIGN         16
+
+// Arena blocks are at least this big.  Bigger buffers get a block of their
+// own.
+#define memioBlockSIZE     (64 * 1024)
+
+// Most pooled buffers kept for reuse.
+#define memioPoolCOUNT     16
+
+/******************************************************************************
+type:
+******************************************************************************/
+// In front of every buffer.
+typedef union
+{
+   Gsize              size;
+   Gn1                pad[memioALIGN];
+} MemioHeader;
+
+// One arena block.  The buffers follow it.
+typedef struct MemioBlock MemioBlock;
+struct MemioBlock
+{
+   MemioBlock        *next;
+   Gsize              size;
+   Gsize              used;
+   Gn1                pad[memioALIGN - (2 * sizeof(Gsize) + sizeof(void *)) % memioALIGN];
+};
+
+struct Memio
+{
+   Gb                 isArena;
+   TaskioLock        *lock;
+   MemioBlock        *block;
+};
+
+/******************************************************************************
+variable:
+******************************************************************************/
+static GimgioAllocator _allocator;
+
+// Pooled buffers free for reuse.  No pool without the lock, before 
+// memioStart.
+static TaskioLock     *_poolLock;
+static void           *_pool[memioPoolCOUNT];
+static Gcount          _poolCount;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+static void *_Create(       Gsize const size);
+static void  _Destroy(      void * const buffer);
+
+static void  _PoolDestroy(  void);
+
+/******************************************************************************
+global: to library only
+function:
+******************************************************************************/
+/******************************************************************************
+func: memioCreate
+
+Create the memory of one image.  Takes arena mode from the allocator.
+******************************************************************************/
+Memio *memioCreate(void)
+{
+   genter;
+
+   Memio *mem;
+
+   mem = (Memio *) _Create(sizeof(Memio));
+   greturnNullIf(!mem);
+
+   memset(mem, 0, sizeof(Memio));
+
+   mem->isArena = _allocator.isArena;
+   if (mem->isArena)
+   {
+      // Codecs may allocate off more than one thread.
+      mem->lock = taskioLockCreate();
+      if (!mem->lock)
+      {
+         _Destroy(mem);
+         greturn NULL;
+      }
+   }
+
+   greturn mem;
+}
+
+/******************************************************************************
+func: memioCreateBuffer memioCreateBufferNoClear
+
+Create a buffer.  memioCreateBuffer zeroes it, memioCreateBufferNoClear 
+leaves it as it comes for buffers that are written before they are read, 
+like the spng and zlib buffers.
+******************************************************************************/
+void *memioCreateBuffer(Memio * const mem, Gsize const size)
+{
+   genter;
+
+   void *buffer;
+
+   buffer = memioCreateBufferNoClear(mem, size);
+   greturnNullIf(!buffer);
+
+   memset(buffer, 0, size);
+
+   greturn buffer;
+}
+
+void *memioCreateBufferNoClear(Memio * const mem, Gsize const size)
+{
+   genter;
+
+   MemioHeader *header;
+   MemioBlock  *block;
+   Gsize        sizeAll;
+
+   sizeAll = sizeof(MemioHeader) + (size + memioALIGN - 1) / memioALIGN * memioALIGN;
+
+   // Straight off the allocator.
+   if (!mem ||
+       !mem->isArena)
+   {
+      header = (MemioHeader *) _Create(sizeAll);
+      greturnNullIf(!header);
+   }
+   else
+   {
+      taskioLockOn(mem->lock);
+
+      block = mem->block;
+      if (!block ||
+          block->size - block->used < sizeAll)
+      {
+         block = (MemioBlock *) _Create(sizeof(MemioBlock) + gMAX(sizeAll, memioBlockSIZE));
+         if (!block)
+         {
+            taskioLockOff(mem->lock);
+            greturn NULL;
+         }
+
+         block->size = gMAX(sizeAll, memioBlockSIZE);
+         block->used = 0;
+
+         // A block for one big buffer goes behind the current block so 
+         // what is left of that can still be used.
+         if (mem->block &&
+             sizeAll > memioBlockSIZE)
+         {
+            block->next      = mem->block->next;
+            mem->block->next = block;
+         }
+         else
+         {
+            block->next      = mem->block;
+            mem->block       = block;
+         }
+      }
+
+      header       = (MemioHeader *) ((Gn1 *) (block + 1) + block->used);
+      block->used += sizeAll;
+
+      taskioLockOff(mem->lock);
+   }
+
+   header->size = size;
+
+   greturn header + 1;
+}
+
+/******************************************************************************
+func: memioCreateBufferPooled
+
+Create a buffer that outlives the image, like an IO buffer.  A free one of 
+at least size is taken off the pool when there is one.  Not zeroed when it
+comes off the pool.  Give it back with memioDestroyBufferPooled.
+******************************************************************************/
+void *memioCreateBufferPooled(Gsize const size)
+{
+   genter;
+
+   void *buffer;
+
+   if (_poolLock)
+   {
+      taskioLockOn(_poolLock);
+
+      while (_poolCount)
+      {
+         _poolCount--;
+         buffer = _pool[_poolCount];
+
+         if ((((MemioHeader *) buffer) - 1)->size >= size)
+         {
+            taskioLockOff(_poolLock);
+            greturn buffer;
+         }
+
+         // Left from before a smaller size was set.
+         memioDestroyBuffer(NULL, buffer);
+      }
+
+      taskioLockOff(_poolLock);
+   }
+
+   greturn memioCreateBufferNoClear(NULL, size);
+}
+
+/******************************************************************************
+func: memioDestroy
+
+Destroy the memory of an image.  In arena mode everything that came from it
+goes too.
+******************************************************************************/
+void memioDestroy(Memio * const mem)
+{
+   genter;
+
+   MemioBlock *block;
+   MemioBlock *next;
+
+   greturnVoidIf(!mem);
+
+   for (block = mem->block; block; block = next)
+   {
+      next = block->next;
+      _Destroy(block);
+   }
+
+   taskioLockDestroy(mem->lock);
+   _Destroy(mem);
+
+   greturn;
+}
+
+/******************************************************************************
+func: memioDestroyBuffer
+
+Destroy a buffer.  In arena mode it stays until the arena goes.
+******************************************************************************/
+void memioDestroyBuffer(Memio * const mem, void * const buffer)
+{
+   genter;
+
+   greturnVoidIf(
+      !buffer ||
+      (mem && mem->isArena));
+
+   _Destroy(((MemioHeader *) buffer) - 1);
+
+   greturn;
+}
+
+/******************************************************************************
+func: memioDestroyBufferPooled
+
+Give a buffer from memioCreateBufferPooled back to the pool.  It is freed 
+when the pool is full.
+******************************************************************************/
+void memioDestroyBufferPooled(void * const buffer)
+{
+   genter;
+
+   greturnVoidIf(!buffer);
+
+   if (_poolLock)
+   {
+      taskioLockOn(_poolLock);
+
+      if (_poolCount < memioPoolCOUNT)
+      {
+         _pool[_poolCount++] = buffer;
+
+         taskioLockOff(_poolLock);
+         greturn;
+      }
+
+      taskioLockOff(_poolLock);
+   }
+
+   memioDestroyBuffer(NULL, buffer);
+
+   greturn;
+}
+
+/******************************************************************************
+func: memioIsArena
+
+Is the memory an arena.  Its buffers are then only freed all at once.
+******************************************************************************/
+Gb memioIsArena(Memio const * const mem)
+{
+   genter;
+
+   greturn (mem && mem->isArena);
+}
+
+/******************************************************************************
+func: memioResizeBuffer
+
+Resize a buffer, keeping what fits.  Anything added is not cleared.  A NULL
+buffer is created.  On failure the old buffer is left alone and NULL is 
+returned.
+******************************************************************************/
+void *memioResizeBuffer(Memio * const mem, void * const buffer, Gsize const size)
+{
+   genter;
+
+   void  *bufferNew;
+   Gsize  sizeOld;
+
+   greturnIf(!buffer, memioCreateBufferNoClear(mem, size));
+
+   sizeOld = (((MemioHeader *) buffer) - 1)->size;
+
+   bufferNew = memioCreateBufferNoClear(mem, size);
+   greturnNullIf(!bufferNew);
+
+   memcpy(bufferNew, buffer, gMIN(size, sizeOld));
+   memioDestroyBuffer(mem, buffer);
+
+   greturn bufferNew;
+}
+
+/******************************************************************************
+func: memioSetAllocator
+
+Set the allocator.  NULL goes back to gmem.
+******************************************************************************/
+void memioSetAllocator(GimgioAllocator const * const allocator)
+{
+   genter;
+
+   // The pooled buffers belong to the old allocator.
+   _PoolDestroy();
+
+   memset(&_allocator, 0, sizeof(_allocator));
+   if (allocator)
+   {
+      _allocator = *allocator;
+   }
+
+   // Both or neither.
+   if (!_allocator.Create ||
+       !_allocator.Destroy)
+   {
+      _allocator.Create  = NULL;
+      _allocator.Destroy = NULL;
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: memioStart
+
+Set up the buffer pool.
+******************************************************************************/
+Gb memioStart(void)
+{
+   genter;
+
+   greturnTrueIf(_poolLock);
+
+   _poolLock = taskioLockCreate();
+   greturnFalseIf(!_poolLock);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: memioStop
+
+Free the pooled buffers.  No pooling after this until memioStart.
+******************************************************************************/
+void memioStop(void)
+{
+   genter;
+
+   _PoolDestroy();
+
+   taskioLockDestroy(_poolLock);
+   _poolLock = NULL;
+
+   greturn;
+}
+
+/******************************************************************************
+local:
+function:
+******************************************************************************/
+/******************************************************************************
+func: _Create
+
+Get memory off the allocator.  Not zeroed.  Neither the allocator nor gmem 
+promise more than 8 byte alignment so a little extra is asked for and the 
+start is moved up to the next memioALIGN boundary.  How far it moved is kept
+in the byte in front for _Destroy.
+******************************************************************************/
+static void *_Create(Gsize const size)
+{
+   Gn1 *base,
+       *buffer;
+
+   if (_allocator.Create)
+   {
+      base = (Gn1 *) _allocator.Create(_allocator.user, size + memioALIGN);
+   }
+   else
+   {
+      base = gmemCreateTypeArray(Gn1, size + memioALIGN);
+   }
+   if (!base)
+   {
+      return NULL;
+   }
+
+   // Always moves at least 1 byte so there is room for the offset.
+   buffer     = base + memioALIGN - (uintptr_t) base % memioALIGN;
+   buffer[-1] = (Gn1) (buffer - base);
+
+   return buffer;
+}
+
+/******************************************************************************
+func: _Destroy
+
+Give memory from _Create back to the allocator.
+******************************************************************************/
+static void _Destroy(void * const buffer)
+{
+   Gn1 *base;
+
+   base = (Gn1 *) buffer - ((Gn1 *) buffer)[-1];
+
+   if (_allocator.Create)
+   {
+      _allocator.Destroy(_allocator.user, base);
+      return;
+   }
+
+   gmemDestroy(base);
+}
+
+/******************************************************************************
+func: _PoolDestroy
+
+Free the buffers in the pool.
+******************************************************************************/
+static void _PoolDestroy(void)
+{
+   genter;
+
+   greturnVoidIf(!_poolLock);
+
+   taskioLockOn(_poolLock);
+
+   while (_poolCount)
+   {
+      _poolCount--;
+      memioDestroyBuffer(NULL, _pool[_poolCount]);
+   }
+
+   taskioLockOff(_poolLock);
+
+   greturn;
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+
+file:       memio.h
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Memory for the codecs.  Goes to the allocator given to gimgioSetAllocator, 
+or to gmem when none was, and optionally through a per image arena.
+
+******************************************************************************/
+
+/******************************************************************************
+type:
+******************************************************************************/
+typedef struct Memio Memio;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+#define memioCreateType(     MEM, TYPE)         ((TYPE *) memioCreateBuffer((MEM), gsizeof(TYPE)))
+#define memioCreateTypeArray(MEM, TYPE, COUNT)  ((TYPE *) memioCreateBuffer((MEM), gsizeof(TYPE) * (Gsize) (COUNT)))
+
+Memio *memioCreate(          void);
+void  *memioCreateBuffer(    Memio * const mem, Gsize const size);
+void  *memioCreateBufferNoClear(Memio * const mem, Gsize const size);
+void  *memioCreateBufferPooled(Gsize const size);
+
+void   memioDestroy(         Memio * const mem);
+void   memioDestroyBuffer(   Memio * const mem, void * const buffer);
+void   memioDestroyBufferPooled(void * const buffer);
+
+Gb     memioIsArena(         Memio const * const mem);
+
+void  *memioResizeBuffer(    Memio * const mem, void * const buffer, Gsize const size);
+
+void   memioSetAllocator(    GimgioAllocator const * const allocator);
+
+Gb     memioStart(           void);
+void   memioStop(            void);
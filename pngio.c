@@ -15,19 +15,112 @@ include:
 #include "precompiled.h"
 #include "tp_png/spng.h"
 
+#if defined(SPNG_USE_MINIZ)
+#include <miniz.h>
+#else
+#include <zlib.h>
+#endif
+
 /******************************************************************************
 local: 
+constant:
+******************************************************************************/
+// Bands are kept between these sizes of filtered data.  Smaller compresses 
+// worse, larger holds more rows in memory.
+#define pngBandSizeMIN     ( 64 * 1024)
+#define pngBandSizeMAX     (512 * 1024)
+
+// Rows the decode thread can get ahead by.  About this many bytes.
+#define pngRingSIZE        (1024 * 1024)
+#define pngRingCountMIN    4
+#define pngRingCountMAX    64
+
+/******************************************************************************
 type:
 ******************************************************************************/
+// A band of rows compressed on its own thread.
+typedef struct
+{
+   // The row before the band followed by the rows of the band.  Unfiltered,
+   // 16 bit channels already big endian.
+   Gn1               *row;
+   Gcount             rowCount;
+   Gb                 isLast;
+   // Rows filtered, each behind its filter type byte.  scratch is a row for
+   // trying the filters.
+   Gn1               *filter;
+   Gn1               *scratch;
+   // Compressed.  2 bytes are kept in front for the zlib header and 4 after
+   // for the adler32 so the band goes out as one IDAT.
+   Gn1               *out;
+   size_t             outSize;
+   size_t             outCount;
+   Gn4                adler;
+   Gb                 isOk;
+} PngBand;
+
 typedef struct 
 {
    spng_ctx          *pngContext;
    struct spng_ihdr   pngHeader;
    int                pngFormat;
-   Gcount             pngFileByteCount;
-   Gn1               *pngFileByteList;
+   // Where the png starts in the file.  Needed to restart decoding.
+   GfileIndex         pngFilePosition;
+   // Decoded rows so far.  pngRow holds row pngRowCount - 1 unless that row
+   // was decoded straight into the caller's buffer.  Writing, rows encoded
+   // so far.
+   Gindex             pngRowCount;
+   Gb                 pngIsRowInBuffer;
+   size_t             pngRowSize;
+   size_t             pngRowCapacity;
+   Gn1               *pngRow;
+   // Interlaced images only.  Rows don't come out in order so the whole 
+   // image is decoded.  pngImage is kept for the next file, pngIsImage says
+   // it holds this one.
+   Gb                 pngIsImage;
    size_t             pngImageSize;
+   size_t             pngImageCapacity;
    Gn1               *pngImage;
+   // Reading on a second thread.  It decodes rows into a ring while the 
+   // calling thread converts them.  pngRingHead rows are decoded and 
+   // pngRingTail rows are taken.  The lock is only held to move those on.
+   // The row last taken stays in the ring so it can be asked for again.
+   TaskioThread      *pngRingThread;
+   TaskioLock        *pngRingLock;
+   TaskioSignal      *pngRingSignalRow;
+   TaskioSignal      *pngRingSignalFree;
+   Gn1               *pngRing;
+   Gcount             pngRingCount;
+   Gindex             pngRingHead;
+   Gindex             pngRingTail;
+   Gb                 pngRingIsStop;
+   Gb                 pngRingIsError;
+   // Rows were asked for out of order.  Don't bother with the thread again.
+   Gb                 pngRingIsOff;
+   // Writing.  The type rows are converted to for the encoder.  Gray below 8
+   // bits is converted to BLACK N1 in pngRowGray and then packed.  Rows set 
+   // ahead of the one the encoder needs next are held until their turn, 
+   // ready to encode.
+   Gb                 pngIsEncoding;
+   GimgioType         pngType;
+   int                pngBitDepth;
+   Gn1               *pngRowGray;
+   Gn1              **pngRowPending;
+   int                pngLevel;
+   int                pngStrategy;
+   int                pngFilterChoice;
+   // Writing on more than one thread.  Rows are gathered into a band per 
+   // thread.  The bands are filtered and deflated at the same time, each
+   // ending on a byte boundary so they join into one zlib stream.
+   Gcount             pngBandThreadCount;
+   Gcount             pngBandRowMax;
+   Gcount             pngBandCount;
+   PngBand           *pngBandList;
+   Gindex             pngBandIndex;
+   Gn1 const         *pngBandRowLast;
+   size_t             pngBandPixelSize;
+   Gn4                pngBandAdler;
+   Gb                 pngBandIsStarted;
 } Pngio;
 
 /******************************************************************************
@@ -39,12 +132,53 @@ static void _PngDestroyContent(  Gimgio * const img);
 static Gb   _PngGetPixelRow(     Gimgio * const img, void *const pixel);
 
 static Gb   _PngReadStart(       Gimgio * const img);
+static Gb   _PngReset(           Gimgio * const img);
 
 static Gb   _PngSetImageIndex(   Gimgio * const img, Gi4 const index);
 static Gb   _PngSetPixelRow(     Gimgio * const img, void * const pixel);
 static Gb   _PngSetTypeFile(     Gimgio * const img);
 
 // completely local
+static Gb   _PngDecodeStart(     Gimgio * const img, Pngio * const data);
+
+static Gn4  _PngAdlerJoin(       Gn4 const adler1, Gn4 const adler2, size_t const count2);
+
+static void * SPNG_CDECL _PngAllocCreate(     size_t const size);
+static void * SPNG_CDECL _PngAllocCreateArray(size_t const count, size_t const size);
+static void   SPNG_CDECL _PngAllocDestroy(    void * const buffer);
+static void * SPNG_CDECL _PngAllocResize(     void * const buffer, size_t const size);
+#if defined(SPNG_USE_MINIZ)
+static void *            _PngAllocZCreate(    void * const opaque, size_t const count, size_t const size);
+#else
+static void *            _PngAllocZCreate(    void * const opaque, uInt const count, uInt const size);
+#endif
+static void              _PngAllocZDestroy(   void * const opaque, void * const buffer);
+
+static Gb   _PngBandAddRow(      Gimgio * const img, Pngio * const data, Gn1 const * const row);
+static void _PngBandCompress(    void * const data, Gindex const index);
+static void _PngBandDestroy(     Gimgio * const img, Pngio * const data);
+static Gb   _PngBandStart(       Gimgio * const img, Pngio * const data, struct spng_ihdr const * const ihdr);
+static Gb   _PngBandWrite(       Gimgio * const img, Pngio * const data);
+
+static Gb   _PngEncodeRow(       Gimgio * const img, Pngio * const data, void const * const row);
+static void _PngEncodeRowPrepare(Gimgio * const img, Pngio * const data, void const * const pixel, Gn1 * const row);
+static void _PngEncodeSetCompression(Gimgio * const img, Pngio * const data);
+static void _PngEncodeSetHeader( Gimgio * const img, Pngio * const data, struct spng_ihdr * const ihdr);
+static Gb   _PngEncodeStart(     Gimgio * const img, Pngio * const data);
+
+static int  _PngRead(            spng_ctx * const ctx, void * const user, void * const buffer, size_t const count);
+
+static Gb   _PngRingGetRow(      Gimgio * const img, Pngio * const data, void * const pixel);
+static Gb   _PngRingStart(       Gimgio * const img, Pngio * const data);
+static void _PngRingStop(        Gimgio * const img, Pngio * const data);
+static void _PngRingThread(      void * const data);
+
+static int  _PngWrite(           spng_ctx * const ctx, void * const user, void * const buffer, size_t const count);
+static Gb   _PngWriteChunk(      Gimgio * const img, char const * const type, Gn1 const * const buffer, size_t const count);
+
+static void _PngFilterRow(       int const type, Gn1 const * const prev, Gn1 const * const row, Gn1 * const out, size_t const count, size_t const pixelSize);
+static void _PngFilterRowBest(   int const choice, Gn1 const * const prev, Gn1 const * const row, Gn1 * const out, size_t const count, size_t const pixelSize, Gn1 * const scratch);
+
 #if 0
 static Gb   _CreateRowPointers(  Gimgio * const img, Pngio * const data, Gcount const rowSize);
 
@@ -53,6 +187,19 @@ static void _DestroyRowPointers( Gimgio * const img, Pngio * const data);
 
 static Gb   _WritePng(           Gimgio * const img, Pngio * const data);
 
+/******************************************************************************
+variable:
+******************************************************************************/
+// spng's memory goes to the gimgio allocator.  spng gives no way back to the
+// image so it can't use the image's arena.
+static struct spng_alloc _pngAlloc =
+{
+   _PngAllocCreate,
+   _PngAllocResize,
+   _PngAllocCreateArray,
+   _PngAllocDestroy
+};
+
 /******************************************************************************
 global: to library only
 function: 
@@ -68,13 +215,14 @@ Gb pngioCreateContent(Gimgio * const img)
 
    genter;
 
-   data = gmemCreateType(Pngio);
+   data = memioCreateType(img->memory, Pngio);
    greturnFalseIf(!data);
 
    img->data           = data;
    img->DestroyContent = _PngDestroyContent;
    img->GetPixelRow    = _PngGetPixelRow;
    img->ReadStart      = _PngReadStart;
+   img->Reset          = _PngReset;
    img->SetImageIndex  = _PngSetImageIndex;
    img->SetPixelRow    = _PngSetPixelRow;
    img->SetTypeFile    = _PngSetTypeFile;
@@ -154,354 +302,1675 @@ static void _PngDestroyContent(Gimgio * const img)
    // Reading
    if (img->mode == gimgioOpenREAD)
    {
-      gmemDestroy(data->pngImage);
+      _PngRingStop(img, data);
+
+      spng_ctx_free(data->pngContext);
+      memioDestroyBuffer(img->memory, data->pngRow);
+      memioDestroyBuffer(img->memory, data->pngImage);
    }
    // Writing
    else 
    {
       _WritePng(img, data);
+
+      spng_ctx_free(data->pngContext);
+      memioDestroyBuffer(img->memory, data->pngRow);
+      memioDestroyBuffer(img->memory, data->pngRowGray);
+      memioDestroyBuffer(img->memory, data->pngRowPending);
+      _PngBandDestroy(img, data);
    }
 
    //_DestroyRowPointers(img, data);
 
-   gmemDestroy(img->data);
+   memioDestroyBuffer(img->memory, img->data);
    img->data = NULL;
 
    greturn;
 }
 
 /******************************************************************************
-func: _PngGetPixelRow
+func: _PngAdlerJoin
 
-Read in a pixel row.
+Get the adler32 of two runs of bytes from the adler32 of each.  Same as 
+zlib's adler32_combine which miniz doesn't have.
 ******************************************************************************/
-static Gb _PngGetPixelRow(Gimgio * const img, void * const pixel)
+static Gn4 _PngAdlerJoin(Gn4 const adler1, Gn4 const adler2, size_t const count2)
 {
    genter;
 
-   Pngio *data;
+   Gn4 const base = 65521;
+   Gn4       rem,
+             sum1,
+             sum2;
 
-   data = (Pngio *) img->data;
+   rem   = (Gn4) (count2 % base);
+   sum1  = adler1 & 0xffff;
+   sum2  = (rem * sum1) % base;
+   sum1 += (adler2 & 0xffff) + base - 1;
+   sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
 
-   // Convert the pixel row to what we want.
-   gimgioConvert(
-      img->width,
-      img->typeFile,
-      &data->pngImage[4 * img->width * img->row],
-      img->typePixel,
-      pixel);
+   if (sum1 >= base)        sum1 -= base;
+   if (sum1 >= base)        sum1 -= base;
+   if (sum2 >= (base << 1)) sum2 -= (base << 1);
+   if (sum2 >= base)        sum2 -= base;
 
-   greturn gbTRUE;
+   greturn sum1 | (sum2 << 16);
 }
 
 /******************************************************************************
-func: _PngReadStart
+func: _PngAllocCreate
 
-Read in the image information.
+spng and zlib memory.  All of it goes to the gimgio allocator.  Only spng's
+calloc is cleared.  zlib doesn't need it.
 ******************************************************************************/
-static Gb _PngReadStart(Gimgio * const img)
+static void * SPNG_CDECL _PngAllocCreate(size_t const size)
 {
-   genter;
+   return memioCreateBufferNoClear(NULL, size);
+}
 
-   Gb                 result;
-   Pngio             *data;
-   size_t             limit = ((size_t) 1024 * 1024) * 64;
-   int                ret;
+/******************************************************************************
+func: _PngAllocCreateArray
+******************************************************************************/
+static void * SPNG_CDECL _PngAllocCreateArray(size_t const count, size_t const size)
+{
+   if (size && 
+       count > SIZE_MAX / size)
+   {
+      return NULL;
+   }
 
-   result = gbFALSE;
-   data   = (Pngio *) img->data;
+   return memioCreateBuffer(NULL, count * size);
+}
+
+/******************************************************************************
+func: _PngAllocDestroy
+******************************************************************************/
+static void SPNG_CDECL _PngAllocDestroy(void * const buffer)
+{
+   memioDestroyBuffer(NULL, buffer);
+}
+
+/******************************************************************************
+func: _PngAllocResize
+******************************************************************************/
+static void * SPNG_CDECL _PngAllocResize(void * const buffer, size_t const size)
+{
+   return memioResizeBuffer(NULL, buffer, size);
+}
 
-   data->pngContext = spng_ctx_new(0);
+/******************************************************************************
+func: _PngAllocZCreate
+******************************************************************************/
+#if defined(SPNG_USE_MINIZ)
+static void *_PngAllocZCreate(void * const opaque, size_t const count, size_t const size)
+#else
+static void *_PngAllocZCreate(void * const opaque, uInt const count, uInt const size)
+#endif
+{
+   opaque;
 
-   breakScope
+   if (size && 
+       count > SIZE_MAX / size)
    {
-      // Read in the file
-      breakIf(!gfileGetContent(img->file, &data->pngFileByteCount, &data->pngFileByteList));
+      return NULL;
+   }
 
-      spng_set_crc_action(  data->pngContext, SPNG_CRC_USE, SPNG_CRC_USE);
-      spng_set_chunk_limits(data->pngContext, limit, limit);
-      spng_set_png_buffer(  data->pngContext, data->pngFileByteList, data->pngFileByteCount);
+   return memioCreateBufferNoClear(NULL, (size_t) count * size);
+}
 
-      ret = spng_get_ihdr(data->pngContext, &data->pngHeader);
-      breakIf(ret);
+/******************************************************************************
+func: _PngAllocZDestroy
+******************************************************************************/
+static void _PngAllocZDestroy(void * const opaque, void * const buffer)
+{
+   opaque;
 
-      img->width        = (Gcount) data->pngHeader.width;
-      img->height       = (Gcount) data->pngHeader.height;
-      
-      data->pngFormat = SPNG_FMT_PNG;
-      if      (data->pngHeader.color_type == SPNG_COLOR_TYPE_GRAYSCALE)
-      {
-         img->typeFile = gimgioTypeBLACK;
-      }
-      else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_TRUECOLOR)
-      {
-         img->typeFile = gimgioTypeRGB;
-      }
-      else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_INDEXED)
-      {
-         img->typeFile   = gimgioTypeRGB;
-         data->pngFormat = SPNG_FMT_RGBA8;
-      }
-      else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA)
-      {
-         img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA;
-      }
-      else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA)
-      {
-         img->typeFile = gimgioTypeRGB | gimgioTypeALPHA;
-      }
-      else
-      {
-         break;
-      }
+   memioDestroyBuffer(NULL, buffer);
+}
 
-      if      (data->pngHeader.bit_depth == 8)
-      {
-         img->typeFile |= gimgioTypeN1;
-      }
-      else if (data->pngHeader.bit_depth == 16)
+/******************************************************************************
+func: _PngBandAddRow
+
+Add a row to the band being filled.  Once every thread has a band, or the
+image is done, the bands are compressed and written.
+******************************************************************************/
+static Gb _PngBandAddRow(Gimgio * const img, Pngio * const data, Gn1 const * const row)
+{
+   genter;
+
+   PngBand *band;
+   Gn1     *bandRow;
+   size_t   index;
+
+   band = &data->pngBandList[data->pngBandIndex];
+
+   // The filters look at the row before.  Nothing before the first row.
+   if (band->rowCount == 0)
+   {
+      if (data->pngBandRowLast)
       {
-         img->typeFile |= gimgioTypeN2;
+         memcpy(band->row, data->pngBandRowLast, data->pngRowSize);
       }
       else
       {
-         break;
+         gmemClear(band->row, (Gcount) data->pngRowSize);
       }
+   }
 
-#if 0
-      struct spng_plte plte = {0};
-      ret = spng_get_plte(ctx, &plte);
+   band->rowCount++;
+   bandRow = &band->row[band->rowCount * data->pngRowSize];
 
-      if (ret && 
-          ret != SPNG_ECHUNKAVAIL)
+   // PNG wants 16 bit channels big endian.
+   if (data->pngBitDepth == 16)
+   {
+      for (index = 0; index < data->pngRowSize; index += 2)
       {
-         printf("spng_get_plte() error: %s\n", spng_strerror(ret));
-         goto error;
-      }
+         Gn2 value = *((Gn2 const *) &row[index]);
 
-      if (!ret) 
-      {
-         printf("palette entries: %u\n", plte.n_entries);
+         bandRow[index]     = (Gn1) (value >> 8);
+         bandRow[index + 1] = (Gn1) (value);
       }
-#endif
+   }
+   else
+   {
+      memcpy(bandRow, row, data->pngRowSize);
+   }
 
-      img->format       = gimgioFormatPNG;
-      img->imageCount   = 1;
-      img->imageIndex   = 0;
-      img->row          = 0;
+   data->pngBandRowLast = bandRow;
 
-      spng_decoded_image_size(data->pngContext, data->pngFormat, &data->pngImageSize);
+   band->isLast = (data->pngRowCount == img->height - 1);
 
-      data->pngImage = gmemCreateTypeArray(Gn1, (Gcount) data->pngImageSize);
-      if (!data->pngImage)
-      {
-         gmemDestroy(data->pngFileByteList);
-         break;
-      }
+   greturnTrueIf(
+      band->rowCount < data->pngBandRowMax &&
+      !band->isLast);
 
-      ret = spng_decode_image(
-         data->pngContext, 
-         data->pngImage, 
-         data->pngImageSize, 
-         data->pngFormat, 
-         0);
+   // Band full.
+   data->pngBandIndex++;
 
-      result = gbTRUE;
-   }
+   greturnTrueIf(
+      data->pngBandIndex < data->pngBandThreadCount &&
+      !band->isLast);
 
-   // Clean up
-   gmemDestroy(data->pngFileByteList);
-   data->pngFileByteList = NULL;
+   greturn _PngBandWrite(img, data);
+}
 
-   spng_ctx_free(data->pngContext);
-   data->pngContext = NULL;
+/******************************************************************************
+func: _PngBandCompress
 
-   greturn result;
+taskioRun job.  Filter and deflate one band.  Only the last band finishes
+the deflate stream.  The rest end with a full flush so the next band can 
+follow straight on without needing anything from this one.
+******************************************************************************/
+static void _PngBandCompress(void * const data, Gindex const index)
+{
+   genter;
+
+   Pngio    *png;
+   PngBand  *band;
+   Gindex    rowIndex;
+   Gn1      *prev,
+            *row,
+            *out;
+   int       ret;
+   size_t    filterCount;
+   z_stream  stream;
+
+   png  = (Pngio *) data;
+   band = &png->pngBandList[index];
+
+   band->isOk     = gbFALSE;
+   band->outCount = 0;
+
+   forCount(rowIndex, band->rowCount)
+   {
+      prev = &band->row[ rowIndex      * png->pngRowSize];
+      row  = &band->row[(rowIndex + 1) * png->pngRowSize];
+      out  = &band->filter[rowIndex * (png->pngRowSize + 1)];
+
+      _PngFilterRowBest(
+         png->pngFilterChoice, 
+         prev, 
+         row, 
+         out, 
+         png->pngRowSize, 
+         png->pngBandPixelSize, 
+         band->scratch);
+   }
+   filterCount = band->rowCount * (png->pngRowSize + 1);
+
+   band->adler = (Gn4) adler32(1, band->filter, (uInt) filterCount);
+
+   // Raw deflate.  The zlib header and adler32 are added when written.
+   memset(&stream, 0, sizeof(stream));
+   stream.zalloc = _PngAllocZCreate;
+   stream.zfree  = _PngAllocZDestroy;
+   greturnVoidIf(
+      deflateInit2(
+         &stream, 
+         png->pngLevel, 
+         Z_DEFLATED, 
+         -15, 
+         8, 
+         png->pngStrategy) != Z_OK);
+
+   stream.next_in   = band->filter;
+   stream.avail_in  = (uInt) filterCount;
+   stream.next_out  = &band->out[2];
+   stream.avail_out = (uInt) (band->outSize - 6);
+
+   ret = deflate(&stream, band->isLast ? Z_FINISH : Z_FULL_FLUSH);
+
+   band->isOk = 
+      (band->isLast) ? 
+         (ret == Z_STREAM_END) :
+         (ret == Z_OK && stream.avail_in == 0 && stream.avail_out != 0);
+   band->outCount = stream.total_out;
+
+   deflateEnd(&stream);
+
+   greturn;
 }
 
 /******************************************************************************
-func: _PngSetImageIndex
+func: _PngBandDestroy
 
-Png doesn't support multiple images per file.
+Clean up the bands.
 ******************************************************************************/
-static Gb _PngSetImageIndex(Gimgio * const img, Gi4 const index)
+static void _PngBandDestroy(Gimgio * const img, Pngio * const data)
 {
    genter;
 
-   img; index;
-   
-   greturn gbFALSE;
+   Gindex index;
+
+   greturnVoidIf(!data->pngBandList);
+
+   forCount(index, data->pngBandThreadCount)
+   {
+      memioDestroyBuffer(img->memory, data->pngBandList[index].row);
+      memioDestroyBuffer(img->memory, data->pngBandList[index].filter);
+      memioDestroyBuffer(img->memory, data->pngBandList[index].scratch);
+      memioDestroyBuffer(img->memory, data->pngBandList[index].out);
+   }
+
+   memioDestroyBuffer(img->memory, data->pngBandList);
+   data->pngBandList = NULL;
+
+   greturn;
 }
 
 /******************************************************************************
-func: _PngSetPixelRow
+func: _PngBandStart
 
-Set the pixels of a row.
+See if the image is worth spreading over threads.  If so write out the 
+start of the file.  Without spng the chunks are written here.
 ******************************************************************************/
-static Gb _PngSetPixelRow(Gimgio * const img, void * const pixel)
+static Gb _PngBandStart(Gimgio * const img, Pngio * const data, 
+   struct spng_ihdr const * const ihdr)
 {
    genter;
 
-   Pngio *data;
+   static Gn1 const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
 
-   data = (Pngio *) img->data;
+   Gcount   threadCount,
+            rowMin,
+            rowMax;
+   Gindex   index;
+   PngBand *band;
+   size_t   filterSize;
+   Gn1      header[13];
 
-   gimgioConvert(
-      img->width, 
-      img->typePixel,
-      pixel,
-      img->typeFile,
-      &data->pngImage[4 * img->width * img->row]);
+   threadCount = img->threadCount;
+   if (threadCount == 0)
+   {
+      threadCount = taskioGetCoreCount();
+   }
+   greturnTrueIf(threadCount <= 1);
+
+   // Size the bands.  An even split over the threads unless that makes them
+   // too big or too small.
+   rowMin = (Gcount) gMAX(1, pngBandSizeMIN / (data->pngRowSize + 1));
+   rowMax = (Gcount) gMAX(1, pngBandSizeMAX / (data->pngRowSize + 1));
+
+   data->pngBandRowMax = (img->height + threadCount - 1) / threadCount;
+   data->pngBandRowMax = gMIN(data->pngBandRowMax, rowMax);
+   data->pngBandRowMax = gMAX(data->pngBandRowMax, rowMin);
+
+   // One band.  Nothing to spread.
+   greturnTrueIf(data->pngBandRowMax >= img->height);
+
+   data->pngBandThreadCount = gMIN(threadCount, (img->height + data->pngBandRowMax - 1) / data->pngBandRowMax);
+
+   // Bytes in a pixel, at least 1, for the filters.
+   switch (ihdr->color_type)
+   {
+   case SPNG_COLOR_TYPE_GRAYSCALE:       data->pngBandPixelSize = 1; break;
+   case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA: data->pngBandPixelSize = 2; break;
+   case SPNG_COLOR_TYPE_TRUECOLOR:       data->pngBandPixelSize = 3; break;
+   default:                              data->pngBandPixelSize = 4; break;
+   }
+   data->pngBandPixelSize = gMAX(1, data->pngBandPixelSize * ihdr->bit_depth / 8);
+
+   data->pngBandList = memioCreateTypeArray(img->memory, PngBand, data->pngBandThreadCount);
+   greturnFalseIf(!data->pngBandList);
+
+   filterSize = data->pngBandRowMax * (data->pngRowSize + 1);
+   forCount(index, data->pngBandThreadCount)
+   {
+      band = &data->pngBandList[index];
+
+      band->row     = memioCreateTypeArray(img->memory, Gn1, (Gcount) ((data->pngBandRowMax + 1) * data->pngRowSize));
+      band->filter  = memioCreateTypeArray(img->memory, Gn1, (Gcount) filterSize);
+      band->scratch = memioCreateTypeArray(img->memory, Gn1, (Gcount) data->pngRowSize);
+      band->outSize = deflateBound(NULL, (uLong) filterSize) + 16 + 6;
+      band->out     = memioCreateTypeArray(img->memory, Gn1, (Gcount) band->outSize);
+      greturnFalseIf(
+         !band->row     ||
+         !band->filter  ||
+         !band->scratch ||
+         !band->out);
+   }
+
+   // Signature and header.
+   header[0]  = (Gn1) (ihdr->width  >> 24);
+   header[1]  = (Gn1) (ihdr->width  >> 16);
+   header[2]  = (Gn1) (ihdr->width  >>  8);
+   header[3]  = (Gn1) (ihdr->width);
+   header[4]  = (Gn1) (ihdr->height >> 24);
+   header[5]  = (Gn1) (ihdr->height >> 16);
+   header[6]  = (Gn1) (ihdr->height >>  8);
+   header[7]  = (Gn1) (ihdr->height);
+   header[8]  = ihdr->bit_depth;
+   header[9]  = ihdr->color_type;
+   header[10] = 0;
+   header[11] = 0;
+   header[12] = 0;
+
+   greturnFalseIf(
+      !streamioSet(img->stream, 8, signature) ||
+      !_PngWriteChunk(img, "IHDR", header, 13));
 
    greturn gbTRUE;
 }
 
 /******************************************************************************
-func: _PngSetTypeFile
+func: _PngBandWrite
 
-Ensure the given type is allowed.  If not default to something valid.
+Compress the bands there are and write them out in order.
 ******************************************************************************/
-static Gb _PngSetTypeFile(Gimgio * const img)
+static Gb _PngBandWrite(Gimgio * const img, Pngio * const data)
 {
    genter;
 
-   switch(img->typeFile)
-   {
-   case gimgioTypeBLACK | gimgioTypeB1:
-   case gimgioTypeBLACK | gimgioTypeB2:
-   case gimgioTypeBLACK | gimgioTypeB4:
-   case gimgioTypeBLACK | gimgioTypeN1:
-   case gimgioTypeBLACK | gimgioTypeN2:
-      // supported by PNG.
-      return gbFALSE; 
-   
-   case gimgioTypeBLACK | gimgioTypeN4:
-   case gimgioTypeBLACK | gimgioTypeR4:
-   case gimgioTypeBLACK | gimgioTypeR8:
-      img->typeFile = gimgioTypeBLACK | gimgioTypeN2;
-      return gbFALSE;
+   Gindex   index;
+   PngBand *band;
+   Gn1     *chunk;
+   size_t   chunkCount;
+   int      level;
+   Gb       isLast;
 
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB1:
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB2:
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB4:
-      img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN1;
-      return gbFALSE;
+   taskioRun(data->pngBandThreadCount, data->pngBandIndex, _PngBandCompress, data);
 
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN1:
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2:
-      // supported by PNG.
-      return gbFALSE;
+   isLast = gbFALSE;
+   forCount(index, data->pngBandIndex)
+   {
+      band = &data->pngBandList[index];
+      greturnFalseIf(!band->isOk);
 
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN4:
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR4:
-   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR8:
-      img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2;
-      return gbFALSE;
+      chunk      = &band->out[2];
+      chunkCount = band->outCount;
 
-   case gimgioTypeRGB | gimgioTypeB1:
-   case gimgioTypeRGB | gimgioTypeB2:
-   case gimgioTypeRGB | gimgioTypeB4:
-      img->typeFile = gimgioTypeRGB | gimgioTypeN1;
-      return gbFALSE;
+      // zlib header in front of the first band.
+      if (!data->pngBandIsStarted)
+      {
+         level = 
+            (data->pngLevel <= 1) ? 0 :
+            (data->pngLevel <= 5) ? 1 :
+            (data->pngLevel == 6) ? 2 :
+                                    3;
+
+         chunk    -= 2;
+         chunk[0]  = 0x78;
+         chunk[1]  = (Gn1) (level << 6);
+         chunk[1] += (Gn1) (31 - ((chunk[0] * 256 + chunk[1]) % 31));
+         chunkCount += 2;
+
+         data->pngBandAdler     = band->adler;
+         data->pngBandIsStarted = gbTRUE;
+      }
+      else
+      {
+         data->pngBandAdler = _PngAdlerJoin(
+            data->pngBandAdler, 
+            band->adler, 
+            band->rowCount * (data->pngRowSize + 1));
+      }
 
-   case gimgioTypeRGB | gimgioTypeN1:
-   case gimgioTypeRGB | gimgioTypeN2:
-      // supported by PNG.
-      return gbFALSE;
+      // adler32 of all the filtered rows after the last band.
+      if (band->isLast)
+      {
+         band->out[2 + band->outCount    ] = (Gn1) (data->pngBandAdler >> 24);
+         band->out[2 + band->outCount + 1] = (Gn1) (data->pngBandAdler >> 16);
+         band->out[2 + band->outCount + 2] = (Gn1) (data->pngBandAdler >>  8);
+         band->out[2 + band->outCount + 3] = (Gn1) (data->pngBandAdler);
+         chunkCount += 4;
 
-   case gimgioTypeRGB | gimgioTypeN4:
-   case gimgioTypeRGB | gimgioTypeR4:
-   case gimgioTypeRGB | gimgioTypeR8:
-      img->typeFile = gimgioTypeRGB | gimgioTypeN2;
-      return gbFALSE;
+         isLast = gbTRUE;
+      }
 
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB1:
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB2:
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB4:
-      img->typeFile = gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN1;
-      return gbFALSE;
+      greturnFalseIf(!_PngWriteChunk(img, "IDAT", chunk, chunkCount));
 
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN1:
-      // supported by PNG.
-      return gbTRUE;
+      band->rowCount = 0;
+   }
 
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN2:
-      return gbFALSE;
+   data->pngBandIndex = 0;
 
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN4:
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeR4:
-   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeR8:
-      img->typeFile = gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN2;
-      return gbFALSE;
+   if (isLast)
+   {
+      greturnFalseIf(!_PngWriteChunk(img, "IEND", NULL, 0));
    }
 
-   // Should never reach this.
-   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
-   
-   greturn gbFALSE;
+   greturn gbTRUE;
 }
 
 /******************************************************************************
-func: _WritePng
+func: _PngDecodeStart
 
-Write out the png file.
+Start or restart the progressive decode.  The context is fed from the file
+through _PngRead so only a few rows are ever held in memory.
 ******************************************************************************/
-static Gb _WritePng(Gimgio * const img, Pngio * const data) 
+static Gb _PngDecodeStart(Gimgio * const img, Pngio * const data)
 {
    genter;
 
-   int    error;
-   size_t size;
+   int ret;
 
-   // Specify image dimensions, PNG format 
-   struct spng_ihdr ihdr =
+   // Restarting, the context has already read past what we need.
+   if (data->pngRowCount)
    {
-       .width      = img->width,
-       .height     = img->height,
-       .bit_depth  = 8,
-       .color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA
-   };
+      spng_ctx_free(data->pngContext);
+      data->pngContext  = NULL;
+      data->pngRowCount = 0;
 
-   // Creating an encoder context requires a flag
-   data->pngContext = spng_ctx_new(SPNG_CTX_ENCODER);
+      greturnFalseIf(!streamioSetPosition(img->stream, data->pngFilePosition));
+   }
 
-   // Encode to internal buffer managed by the library
-   spng_set_option(data->pngContext, SPNG_ENCODE_TO_BUFFER, 1);
+   if (!data->pngContext)
+   {
+      data->pngContext = spng_ctx_new2(&_pngAlloc, 0);
+      greturnFalseIf(!data->pngContext);
 
-   // Image will be encoded according to ihdr.color_type, .bit_depth
-   spng_set_ihdr(data->pngContext, &ihdr);
+      spng_set_crc_action(  data->pngContext, SPNG_CRC_USE, SPNG_CRC_USE);
+      spng_set_chunk_limits(data->pngContext, ((size_t) 1024 * 1024) * 64, ((size_t) 1024 * 1024) * 64);
+      spng_set_png_stream(  data->pngContext, _PngRead, img);
+   }
 
-   // SPNG_FMT_PNG is a special value that matches the format in ihdr,
-   // SPNG_ENCODE_FINALIZE will finalize the PNG with the end-of-file marker
-   spng_encode_image(
-      data->pngContext, 
-      data->pngImage, 
-      data->pngImageSize, 
-      SPNG_FMT_PNG, 
-      SPNG_ENCODE_FINALIZE);
-
-   // PNG is written to an internal buffer by default
-   error = gbFALSE;
-   data->pngFileByteList = spng_get_png_buffer(data->pngContext, &size, &error);
-   if (data->pngFileByteList)
-   {
-      data->pngFileByteCount = (Gcount) size;
-      if (!gfileStoreContent(
-            img->fileName, 
-            data->pngFileByteCount, 
-            data->pngFileByteList))
+   ret = spng_decoded_image_size(data->pngContext, data->pngFormat, &data->pngImageSize);
+   greturnFalseIf(ret);
+
+   // Interlaced rows come out of order.  Decode the whole image.
+   if (data->pngHeader.interlace_method != SPNG_INTERLACE_NONE)
+   {
+      if (data->pngImageCapacity < data->pngImageSize)
       {
-         error = gbTRUE;
-      }
-   }
+         memioDestroyBuffer(img->memory, data->pngImage);
+         data->pngImageCapacity = 0;
 
-   // User owns the buffer after a successful call
-   free(data->pngFileByteList);
+         data->pngImage = memioCreateTypeArray(img->memory, Gn1, (Gcount) data->pngImageSize);
+         greturnFalseIf(!data->pngImage);
+
+         data->pngImageCapacity = data->pngImageSize;
+      }
+
+      ret = spng_decode_image(
+         data->pngContext, 
+         data->pngImage, 
+         data->pngImageSize, 
+         data->pngFormat, 
+         0);
+      greturnFalseIf(ret);
+
+      data->pngRowSize  = data->pngImageSize / img->height;
+      data->pngRowCount = img->height;
+      data->pngIsImage  = gbTRUE;
+
+      greturn gbTRUE;
+   }
+
+   ret = spng_decode_image(
+      data->pngContext, 
+      NULL, 
+      0, 
+      data->pngFormat, 
+      SPNG_DECODE_PROGRESSIVE);
+   greturnFalseIf(ret);
+
+   data->pngRowSize = data->pngImageSize / img->height;
+   if (data->pngRowCapacity < data->pngRowSize)
+   {
+      memioDestroyBuffer(img->memory, data->pngRow);
+      data->pngRowCapacity = 0;
+
+      data->pngRow = memioCreateTypeArray(img->memory, Gn1, (Gcount) data->pngRowSize);
+      greturnFalseIf(!data->pngRow);
+
+      data->pngRowCapacity = data->pngRowSize;
+   }
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngEncodeRow
+
+Feed the next row to the encoder.  Compressed data goes out to the file as 
+it is made.
+******************************************************************************/
+static Gb _PngEncodeRow(Gimgio * const img, Pngio * const data, void const * const row)
+{
+   genter;
+
+   int ret;
+
+   if (data->pngBandList)
+   {
+      greturnFalseIf(!_PngBandAddRow(img, data, (Gn1 const *) row));
+   }
+   else
+   {
+      ret = spng_encode_row(data->pngContext, row, data->pngRowSize);
+
+      // The last row returns SPNG_EOI once the file is finished.
+      greturnFalseIf(
+         ret &&
+         ret != SPNG_EOI);
+   }
+
+   data->pngRowCount++;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngEncodeRowPrepare
+
+Convert the caller's row to what the encoder takes.
+******************************************************************************/
+static void _PngEncodeRowPrepare(Gimgio * const img, Pngio * const data, 
+   void const * const pixel, Gn1 * const row)
+{
+   genter;
+
+   Gindex index;
+   int    shift;
+
+   if (data->pngBitDepth >= 8)
+   {
+      gimgioConvert(img->width, img->typePixel, pixel, data->pngType, row);
+
+      greturn;
+   }
+
+   gimgioConvert(img->width, img->typePixel, pixel, data->pngType, data->pngRowGray);
+
+   // Pack the gray, most significant bits first.
+   gmemClear(row, (Gcount) data->pngRowSize);
+   forCount(index, img->width)
+   {
+      shift = 8 - data->pngBitDepth * (index % (8 / data->pngBitDepth) + 1);
+
+      row[index / (8 / data->pngBitDepth)] |= 
+         (Gn1) ((data->pngRowGray[index] >> (8 - data->pngBitDepth)) << shift);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngEncodeSetCompression
+
+Map the compression amount on to zlib and the filters.  0 stores the rows 
+as is.  The lowest amounts, gimgioCompressionFASTEST, only try the up filter
+and look for runs.  The rest try all filters with the zlib level rising 
+with the amount.  The band encoder and the spng context both use these.
+******************************************************************************/
+static void _PngEncodeSetCompression(Gimgio * const img, Pngio * const data)
+{
+   genter;
+
+   data->pngLevel = (int) (img->compression * 9. + .999);
+   data->pngLevel = gMAX(0, data->pngLevel);
+   data->pngLevel = gMIN(9, data->pngLevel);
+
+   if      (data->pngLevel == 0)
+   {
+      data->pngFilterChoice = SPNG_DISABLE_FILTERING;
+      data->pngStrategy     = Z_DEFAULT_STRATEGY;
+   }
+   else if (data->pngLevel == 1)
+   {
+      data->pngFilterChoice = SPNG_FILTER_CHOICE_UP;
+      data->pngStrategy     = Z_RLE;
+   }
+   else
+   {
+      data->pngFilterChoice = SPNG_FILTER_CHOICE_ALL;
+      data->pngStrategy     = Z_FILTERED;
+   }
+
+   // libpng's choice.  Below 8 bits a byte holds several pixels so the 
+   // filters predict from the wrong neighbours and rarely pay for the filter
+   // byte.
+   if (data->pngBitDepth < 8)
+   {
+      data->pngFilterChoice = SPNG_DISABLE_FILTERING;
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngEncodeSetHeader
+
+Fill in the header from the file type.
+******************************************************************************/
+static void _PngEncodeSetHeader(Gimgio * const img, Pngio * const data, 
+   struct spng_ihdr * const ihdr)
+{
+   genter;
+
+   // Not set, follow the pixels.
+   if (img->typeFile == gimgioTypeNONE)
+   {
+      img->typeFile = img->typePixel;
+   }
+   _PngSetTypeFile(img);
+
+   ihdr->width     = img->width;
+   ihdr->height    = img->height;
+
+   data->pngType   = img->typeFile;
+
+   switch (img->typeFile & ~(gimgioTypeBIT | gimgioTypeNATURAL | gimgioTypeREAL))
+   {
+   case gimgioTypeBLACK:
+      ihdr->color_type = SPNG_COLOR_TYPE_GRAYSCALE;
+      break;
+
+   case gimgioTypeBLACK | gimgioTypeALPHA:
+      ihdr->color_type = SPNG_COLOR_TYPE_GRAYSCALE_ALPHA;
+      break;
+
+   case gimgioTypeRGB:
+      ihdr->color_type = SPNG_COLOR_TYPE_TRUECOLOR;
+      break;
+
+   default:
+      ihdr->color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+      break;
+   }
+
+   switch (img->typeFile & (gimgioTypeBIT | gimgioTypeNATURAL))
+   {
+   case gimgioTypeB1: ihdr->bit_depth = 1;  break;
+   case gimgioTypeB2: ihdr->bit_depth = 2;  break;
+   case gimgioTypeB4: ihdr->bit_depth = 4;  break;
+   case gimgioTypeN2: ihdr->bit_depth = 16; break;
+   default:           ihdr->bit_depth = 8;  break;
+   }
+
+   data->pngBitDepth = ihdr->bit_depth;
+   data->pngRowSize  = gimgioGetPixelSize(data->pngType, img->width);
+
+   // Gray below 8 bits.  Rows are made as BLACK N1 and packed.
+   if (ihdr->bit_depth < 8)
+   {
+      data->pngType    = gimgioTypeBLACK | gimgioTypeN1;
+      data->pngRowSize = ((size_t) img->width * ihdr->bit_depth + 7) / 8;
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngEncodeStart
+
+Start the progressive encode.  The header goes out now.  Rows follow as they
+are set.
+******************************************************************************/
+static Gb _PngEncodeStart(Gimgio * const img, Pngio * const data)
+{
+   genter;
+
+   int              ret;
+   struct spng_ihdr ihdr;
+
+   data->pngIsEncoding = gbTRUE;
+
+   gmemClear(&ihdr, gsizeof(ihdr));
+   _PngEncodeSetHeader(img, data, &ihdr);
+
+   data->pngRow = memioCreateTypeArray(img->memory, Gn1, (Gcount) data->pngRowSize);
+   greturnFalseIf(!data->pngRow);
+
+   if (data->pngBitDepth < 8)
+   {
+      data->pngRowGray = memioCreateTypeArray(img->memory, Gn1, img->width);
+      greturnFalseIf(!data->pngRowGray);
+   }
+
+   _PngEncodeSetCompression(img, data);
+
+   // Spread over threads when it is worth it.
+   greturnFalseIf(!_PngBandStart(img, data, &ihdr));
+   greturnTrueIf(data->pngBandList);
+
+   // Creating an encoder context requires a flag
+   data->pngContext = spng_ctx_new2(&_pngAlloc, SPNG_CTX_ENCODER);
+   greturnFalseIf(!data->pngContext);
+
+   spng_set_png_stream(data->pngContext, _PngWrite, img);
+
+   // Image will be encoded according to ihdr.color_type, .bit_depth
+   ret = spng_set_ihdr(data->pngContext, &ihdr);
+   greturnFalseIf(ret);
+
+   spng_set_option(data->pngContext, SPNG_IMG_COMPRESSION_LEVEL,    data->pngLevel);
+   spng_set_option(data->pngContext, SPNG_FILTER_CHOICE,            data->pngFilterChoice);
+   spng_set_option(data->pngContext, SPNG_IMG_COMPRESSION_STRATEGY, data->pngStrategy);
+
+   // SPNG_FMT_PNG is a special value that matches the format in ihdr,
+   // SPNG_ENCODE_FINALIZE will finalize the PNG with the end-of-file marker
+   // after the last row.
+   ret = spng_encode_image(
+      data->pngContext, 
+      NULL, 
+      0, 
+      SPNG_FMT_PNG, 
+      SPNG_ENCODE_PROGRESSIVE | SPNG_ENCODE_FINALIZE);
+   greturnFalseIf(ret);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngFilterRow
+
+Filter a row.  type is the PNG filter type, 0 to 4.
+******************************************************************************/
+static void _PngFilterRow(int const type, Gn1 const * const prev, Gn1 const * const row, 
+   Gn1 * const out, size_t const count, size_t const pixelSize)
+{
+   genter;
+
+   size_t index;
+   int    a,
+          b,
+          c,
+          p,
+          pa,
+          pb,
+          pc;
+
+   switch (type)
+   {
+   case SPNG_FILTER_NONE:
+      memcpy(out, row, count);
+      break;
+
+   case SPNG_FILTER_SUB:
+      for (index = 0; index < count; index++)
+      {
+         a          = (index >= pixelSize) ? row[index - pixelSize] : 0;
+         out[index] = (Gn1) (row[index] - a);
+      }
+      break;
+
+   case SPNG_FILTER_UP:
+      for (index = 0; index < count; index++)
+      {
+         out[index] = (Gn1) (row[index] - prev[index]);
+      }
+      break;
+
+   case SPNG_FILTER_AVERAGE:
+      for (index = 0; index < count; index++)
+      {
+         a          = (index >= pixelSize) ? row[index - pixelSize] : 0;
+         out[index] = (Gn1) (row[index] - ((a + prev[index]) >> 1));
+      }
+      break;
+
+   case SPNG_FILTER_PAETH:
+      for (index = 0; index < count; index++)
+      {
+         a  = (index >= pixelSize) ? row[ index - pixelSize] : 0;
+         b  = prev[index];
+         c  = (index >= pixelSize) ? prev[index - pixelSize] : 0;
+         p  = a + b - c;
+         pa = abs(p - a);
+         pb = abs(p - b);
+         pc = abs(p - c);
+
+         out[index] = (Gn1) (row[index] - 
+            ((pa <= pb && pa <= pc) ? a : 
+             (pb <= pc)             ? b : 
+                                      c));
+      }
+      break;
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngFilterRowBest
+
+Filter a row with the best of the choices, SPNG_FILTER_CHOICE flags.  The 
+usual guess is used, the filter leaving the smallest sum of the bytes taken
+as signed.  out gets the filter type byte then the row.  scratch holds a 
+row.
+******************************************************************************/
+static void _PngFilterRowBest(int const choice, Gn1 const * const prev, Gn1 const * const row, 
+   Gn1 * const out, size_t const count, size_t const pixelSize, Gn1 * const scratch)
+{
+   genter;
+
+   int    type,
+          typeBest;
+   Gn8    sum,
+          sumBest;
+   size_t index;
+   Gb     isSet;
+
+   // None or only one choice.
+   typeBest = SPNG_FILTER_NONE;
+   for (type = SPNG_FILTER_NONE; type <= SPNG_FILTER_PAETH; type++)
+   {
+      if (choice == (SPNG_FILTER_CHOICE_NONE << type))
+      {
+         typeBest = type;
+      }
+   }
+
+   if (choice == SPNG_DISABLE_FILTERING ||
+       choice == (SPNG_FILTER_CHOICE_NONE << typeBest))
+   {
+      out[0] = (Gn1) typeBest;
+      _PngFilterRow(typeBest, prev, row, &out[1], count, pixelSize);
+
+      greturn;
+   }
+
+   isSet   = gbFALSE;
+   sumBest = 0;
+   for (type = SPNG_FILTER_NONE; type <= SPNG_FILTER_PAETH; type++)
+   {
+      continueIf(!(choice & (SPNG_FILTER_CHOICE_NONE << type)));
+
+      _PngFilterRow(type, prev, row, scratch, count, pixelSize);
+
+      sum = 0;
+      for (index = 0; index < count; index++)
+      {
+         sum += (Gn8) abs((int) (Gi1) scratch[index]);
+      }
+
+      // Keep the best so far in out.
+      if (!isSet ||
+          sum < sumBest)
+      {
+         isSet   = gbTRUE;
+         sumBest = sum;
+         out[0]  = (Gn1) type;
+         memcpy(&out[1], scratch, count);
+      }
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngGetPixelRow
+
+Read in a pixel row.  Rows are decoded on demand.  Going backwards restarts
+the decode from the start of the png.
+******************************************************************************/
+static Gb _PngGetPixelRow(Gimgio * const img, void * const pixel)
+{
+   genter;
+
+   Pngio *data;
+   Gb     isDirect;
+   int    ret;
+
+   data = (Pngio *) img->data;
+
+   greturnFalseIf(
+      img->row < 0 ||
+      img->row >= img->height);
+
+   // Decoding on the other thread.  Going backwards goes back to decoding 
+   // on this one.  The row last taken is still in the ring.
+   if (data->pngRingThread)
+   {
+      greturnIf(img->row >= data->pngRingTail, _PngRingGetRow(img, data, pixel));
+
+      if (img->row == data->pngRingTail - 1)
+      {
+         gimgioConvert(
+            img->width,
+            img->typeFile,
+            &data->pngRing[(img->row % data->pngRingCount) * data->pngRowSize],
+            img->typePixel,
+            pixel);
+
+         greturn gbTRUE;
+      }
+
+      _PngRingStop(img, data);
+      data->pngRingIsOff = gbTRUE;
+   }
+
+   if (!data->pngRowCount                  ||
+       img->row <  data->pngRowCount - 1    ||
+       (img->row == data->pngRowCount - 1 && 
+        !data->pngIsRowInBuffer))
+   {
+      if (!data->pngIsImage)
+      {
+         greturnFalseIf(!_PngDecodeStart(img, data));
+      }
+   }
+
+   // Interlaced, the whole image is there.
+   if (data->pngIsImage)
+   {
+      gimgioConvert(
+         img->width,
+         img->typeFile,
+         &data->pngImage[data->pngRowSize * img->row],
+         img->typePixel,
+         pixel);
+
+      greturn gbTRUE;
+   }
+
+   // From the top, hand the decode to another thread when we can.
+   if (data->pngRowCount == 0 &&
+       _PngRingStart(img, data))
+   {
+      greturn _PngRingGetRow(img, data, pixel);
+   }
+
+   // Decode up to the row we want.  With the same layout the row we want 
+   // is decoded straight into the caller's row.
+   while (data->pngRowCount <= img->row)
+   {
+      isDirect = (
+         data->pngRowCount == img->row &&
+         img->typePixel    == img->typeFile);
+
+      ret = spng_decode_row(
+         data->pngContext, 
+         isDirect ? pixel : data->pngRow, 
+         data->pngRowSize);
+      greturnFalseIf(
+         ret &&
+         ret != SPNG_EOI);
+
+      data->pngRowCount++;
+      data->pngIsRowInBuffer = !isDirect;
+   }
+
+   greturnTrueIf(!data->pngIsRowInBuffer);
+
+   // Convert the pixel row to what we want.
+   gimgioConvert(
+      img->width,
+      img->typeFile,
+      data->pngRow,
+      img->typePixel,
+      pixel);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngRead
+
+spng stream callback.  Feed spng from the file.
+******************************************************************************/
+static int _PngRead(spng_ctx * const ctx, void * const user, void * const buffer, 
+   size_t const count)
+{
+   Gimgio *img;
+
+   ctx;
+
+   img = (Gimgio *) user;
+
+   if (streamioGet(img->stream, (Gcount) count, buffer) != (Gcount) count)
+   {
+      return SPNG_IO_EOF;
+   }
+
+   return 0;
+}
+
+/******************************************************************************
+func: _PngWrite
+
+spng stream callback.  Write the encoded png out to the file.
+******************************************************************************/
+static int _PngWrite(spng_ctx * const ctx, void * const user, void * const buffer, 
+   size_t const count)
+{
+   Gimgio *img;
+
+   ctx;
+
+   img = (Gimgio *) user;
+
+   if (!streamioSet(img->stream, (Gcount) count, buffer))
+   {
+      return SPNG_IO_ERROR;
+   }
+
+   return 0;
+}
+
+/******************************************************************************
+func: _PngWriteChunk
+
+Write out a chunk.  Only used when the encode is spread over threads and 
+spng isn't writing the file.
+******************************************************************************/
+static Gb _PngWriteChunk(Gimgio * const img, char const * const type, 
+   Gn1 const * const buffer, size_t const count)
+{
+   genter;
+
+   Gn1  value[4];
+   uLong crc;
+
+   value[0] = (Gn1) (count >> 24);
+   value[1] = (Gn1) (count >> 16);
+   value[2] = (Gn1) (count >>  8);
+   value[3] = (Gn1) (count);
+   greturnFalseIf(
+      !streamioSet(img->stream, 4, value) ||
+      !streamioSet(img->stream, 4, type));
+
+   crc = crc32(0, (Gn1 const *) type, 4);
+   if (count)
+   {
+      greturnFalseIf(!streamioSet(img->stream, (Gcount) count, buffer));
+
+      crc = crc32(crc, buffer, (uInt) count);
+   }
+
+   value[0] = (Gn1) (crc >> 24);
+   value[1] = (Gn1) (crc >> 16);
+   value[2] = (Gn1) (crc >>  8);
+   value[3] = (Gn1) (crc);
+   greturnFalseIf(!streamioSet(img->stream, 4, value));
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngRingGetRow
+
+Get a row off the ring.  Rows before it are skipped.  Waits on the decode
+thread when it hasn't got there yet.
+******************************************************************************/
+static Gb _PngRingGetRow(Gimgio * const img, Pngio * const data, void * const pixel)
+{
+   genter;
+
+   Gb isRow;
+
+   while (data->pngRingTail <= img->row)
+   {
+      taskioLockOn(data->pngRingLock);
+      while (data->pngRingHead == data->pngRingTail &&
+             !data->pngRingIsError)
+      {
+         taskioSignalWait(data->pngRingSignalRow, data->pngRingLock);
+      }
+      isRow = (data->pngRingHead != data->pngRingTail);
+      taskioLockOff(data->pngRingLock);
+
+      greturnFalseIf(!isRow);
+
+      // The decode thread doesn't touch the tail row until we let it go.
+      if (data->pngRingTail == img->row)
+      {
+         gimgioConvert(
+            img->width,
+            img->typeFile,
+            &data->pngRing[(data->pngRingTail % data->pngRingCount) * data->pngRowSize],
+            img->typePixel,
+            pixel);
+      }
+
+      taskioLockOn(data->pngRingLock);
+      data->pngRingTail++;
+      taskioSignalWake(data->pngRingSignalFree);
+      taskioLockOff(data->pngRingLock);
+   }
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngRingStart
+
+Start the decode thread if we may use more than one and the image is worth
+it.  The decode must be at the top.
+******************************************************************************/
+static Gb _PngRingStart(Gimgio * const img, Pngio * const data)
+{
+   genter;
+
+   greturnFalseIf(
+      (img->threadCount ? img->threadCount : taskioGetCoreCount()) <= 1 ||
+      img->height <= 1      ||
+      data->pngRingIsOff    ||
+      data->pngIsImage      ||
+      !data->pngContext);
+
+   data->pngRingCount = (Gcount) (pngRingSIZE / data->pngRowSize);
+   data->pngRingCount = gMAX(data->pngRingCount, pngRingCountMIN);
+   data->pngRingCount = gMIN(data->pngRingCount, pngRingCountMAX);
+
+   data->pngRingHead     = 0;
+   data->pngRingTail     = 0;
+   data->pngRingIsStop   = gbFALSE;
+   data->pngRingIsError  = gbFALSE;
+
+   breakScope
+   {
+      data->pngRing = memioCreateTypeArray(img->memory, Gn1, (Gcount) (data->pngRingCount * data->pngRowSize));
+      breakIf(!data->pngRing);
+
+      data->pngRingLock       = taskioLockCreate();
+      data->pngRingSignalRow  = taskioSignalCreate();
+      data->pngRingSignalFree = taskioSignalCreate();
+      breakIf(
+         !data->pngRingLock      ||
+         !data->pngRingSignalRow ||
+         !data->pngRingSignalFree);
+
+      data->pngRingThread = taskioThreadCreate(_PngRingThread, img);
+      breakIf(!data->pngRingThread);
+
+      greturn gbTRUE;
+   }
+
+   // Couldn't start.  Decode on this thread.
+   _PngRingStop(img, data);
+   data->pngRingIsOff = gbTRUE;
+
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+func: _PngRingStop
+
+Stop the decode thread and clean up.  The rows it decoded count as decoded
+so going on from here means a restart.
+******************************************************************************/
+static void _PngRingStop(Gimgio * const img, Pngio * const data)
+{
+   genter;
+
+   if (data->pngRingThread)
+   {
+      taskioLockOn(data->pngRingLock);
+      data->pngRingIsStop = gbTRUE;
+      taskioSignalWake(data->pngRingSignalFree);
+      taskioLockOff(data->pngRingLock);
+
+      taskioThreadDestroy(data->pngRingThread);
+      data->pngRingThread = NULL;
+
+      data->pngRowCount      = data->pngRingHead;
+      data->pngIsRowInBuffer = gbFALSE;
+   }
+
+   taskioSignalDestroy(data->pngRingSignalFree);
+   taskioSignalDestroy(data->pngRingSignalRow);
+   taskioLockDestroy(  data->pngRingLock);
+   memioDestroyBuffer(img->memory, data->pngRing);
+
+   data->pngRingSignalFree = NULL;
+   data->pngRingSignalRow  = NULL;
+   data->pngRingLock       = NULL;
+   data->pngRing           = NULL;
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngRingThread
+
+Decode thread.  Decode rows into the ring until the image is done, it is
+told to stop or the decode fails.  Waits when the ring is full.
+******************************************************************************/
+static void _PngRingThread(void * const data)
+{
+   genter;
+
+   Gimgio *img;
+   Pngio  *png;
+   Gindex  head;
+   Gcount  height;
+   Gb      isStop,
+           isError;
+   int     ret;
+
+   img    = (Gimgio *) data;
+   png    = (Pngio *)  img->data;
+   // gimgioReopen clears the size before it stops this thread.
+   height = img->height;
+
+   loop
+   {
+      taskioLockOn(png->pngRingLock);
+      // One slot is kept for the row last taken.
+      while (!png->pngRingIsStop &&
+             png->pngRingHead - png->pngRingTail >= png->pngRingCount - 1)
+      {
+         taskioSignalWait(png->pngRingSignalFree, png->pngRingLock);
+      }
+      head   = png->pngRingHead;
+      isStop = png->pngRingIsStop;
+      taskioLockOff(png->pngRingLock);
+
+      breakIf(isStop);
+
+      ret = spng_decode_row(
+         png->pngContext, 
+         &png->pngRing[(head % png->pngRingCount) * png->pngRowSize], 
+         png->pngRowSize);
+
+      taskioLockOn(png->pngRingLock);
+      if (ret &&
+          ret != SPNG_EOI)
+      {
+         png->pngRingIsError = gbTRUE;
+      }
+      else
+      {
+         png->pngRingHead++;
+      }
+      isError = png->pngRingIsError;
+      taskioSignalWake(png->pngRingSignalRow);
+      taskioLockOff(png->pngRingLock);
+
+      breakIf(
+         isError ||
+         head + 1 >= height);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _PngReadStart
+
+Read in the image information.  Only the header is read.  Decoding starts
+with the first row requested.
+******************************************************************************/
+static Gb _PngReadStart(Gimgio * const img)
+{
+   genter;
+
+   Pngio             *data;
+   size_t             limit = ((size_t) 1024 * 1024) * 64;
+   int                ret;
+
+   data   = (Pngio *) img->data;
+
+   data->pngFilePosition = streamioGetPosition(img->stream);
+
+   data->pngContext = spng_ctx_new2(&_pngAlloc, 0);
+   greturnFalseIf(!data->pngContext);
+
+   spng_set_crc_action(  data->pngContext, SPNG_CRC_USE, SPNG_CRC_USE);
+   spng_set_chunk_limits(data->pngContext, limit, limit);
+   spng_set_png_stream(  data->pngContext, _PngRead, img);
+
+   ret = spng_get_ihdr(data->pngContext, &data->pngHeader);
+   greturnFalseIf(ret);
+
+   img->width        = (Gcount) data->pngHeader.width;
+   img->height       = (Gcount) data->pngHeader.height;
+   
+   data->pngFormat = SPNG_FMT_PNG;
+   if      (data->pngHeader.color_type == SPNG_COLOR_TYPE_GRAYSCALE)
+   {
+      img->typeFile = gimgioTypeBLACK;
+
+      // Packed gray is expanded by spng.
+      if (data->pngHeader.bit_depth < 8)
+      {
+         data->pngFormat = SPNG_FMT_G8;
+      }
+   }
+   else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_TRUECOLOR)
+   {
+      img->typeFile = gimgioTypeRGB;
+   }
+   else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_INDEXED)
+   {
+      // The palette is expanded to RGBA by spng.
+      img->typeFile   = gimgioTypeRGB | gimgioTypeALPHA;
+      data->pngFormat = SPNG_FMT_RGBA8;
+   }
+   else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA)
+   {
+      img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA;
+   }
+   else if (data->pngHeader.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA)
+   {
+      img->typeFile = gimgioTypeRGB | gimgioTypeALPHA;
+   }
+   else
+   {
+      greturn gbFALSE;
+   }
+
+   if      (data->pngHeader.bit_depth == 16)
+   {
+      img->typeFile |= gimgioTypeN2;
+   }
+   else if (data->pngHeader.bit_depth == 8 ||
+            data->pngFormat           != SPNG_FMT_PNG)
+   {
+      img->typeFile |= gimgioTypeN1;
+   }
+   else
+   {
+      greturn gbFALSE;
+   }
+
+   img->format       = gimgioFormatPNG;
+   img->imageCount   = 1;
+   img->imageIndex   = 0;
+   img->row          = 0;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngReset
+
+Ready for the next file.  spng has no way to reset a context so it is made 
+again.  The row buffers are kept.
+******************************************************************************/
+static Gb _PngReset(Gimgio * const img)
+{
+   genter;
+
+   Pngio  *data;
+   Gn1    *row;
+   size_t  rowCapacity;
+   Gn1    *image;
+   size_t  imageCapacity;
+
+   data = (Pngio *) img->data;
+
+   _PngRingStop(img, data);
 
-   // Free context memory 
    spng_ctx_free(data->pngContext);
 
-   greturn !error;
+   row           = data->pngRow;
+   rowCapacity   = data->pngRowCapacity;
+   image         = data->pngImage;
+   imageCapacity = data->pngImageCapacity;
+
+   gmemClear(data, gsizeof(Pngio));
+
+   data->pngRow           = row;
+   data->pngRowCapacity   = rowCapacity;
+   data->pngImage         = image;
+   data->pngImageCapacity = imageCapacity;
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngSetImageIndex
+
+Png doesn't support multiple images per file.
+******************************************************************************/
+static Gb _PngSetImageIndex(Gimgio * const img, Gi4 const index)
+{
+   genter;
+
+   img; index;
+   
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+func: _PngSetPixelRow
+
+Set the pixels of a row.
+******************************************************************************/
+static Gb _PngSetPixelRow(Gimgio * const img, void * const pixel)
+{
+   genter;
+
+   Pngio *data;
+   Gn1   *row;
+
+   data = (Pngio *) img->data;
+
+   if (!data->pngIsEncoding)
+   {
+      greturnFalseIf(!_PngEncodeStart(img, data));
+   }
+
+   // Already encoded.  A row can't be changed once it is in the file.
+   greturnFalseIf(
+      (!data->pngContext && !data->pngBandList) ||
+      img->row < data->pngRowCount);
+
+   // Ahead of the encoder.  Hold on to the row until its turn.
+   if (img->row > data->pngRowCount)
+   {
+      if (!data->pngRowPending)
+      {
+         data->pngRowPending = memioCreateTypeArray(img->memory, Gn1 *, img->height);
+         greturnFalseIf(!data->pngRowPending);
+      }
+
+      if (!data->pngRowPending[img->row])
+      {
+         data->pngRowPending[img->row] = memioCreateTypeArray(img->memory, Gn1, (Gcount) data->pngRowSize);
+         greturnFalseIf(!data->pngRowPending[img->row]);
+      }
+
+      _PngEncodeRowPrepare(img, data, pixel, data->pngRowPending[img->row]);
+
+      greturn gbTRUE;
+   }
+
+   // The row the encoder needs next.  Same layout, encode the caller's row
+   // as is.
+   row = (Gn1 *) pixel;
+   if (img->typePixel   != data->pngType ||
+       data->pngBitDepth < 8)
+   {
+      _PngEncodeRowPrepare(img, data, pixel, data->pngRow);
+
+      row = data->pngRow;
+   }
+
+   greturnFalseIf(!_PngEncodeRow(img, data, row));
+
+   // Any held rows that can now go.
+   if (data->pngRowPending)
+   {
+      while (data->pngRowCount < img->height &&
+             data->pngRowPending[data->pngRowCount])
+      {
+         row = data->pngRowPending[data->pngRowCount];
+         data->pngRowPending[data->pngRowCount] = NULL;
+
+         greturnFalseIf(!_PngEncodeRow(img, data, row));
+
+         memioDestroyBuffer(img->memory, row);
+      }
+   }
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: _PngSetTypeFile
+
+Ensure the given type is allowed.  If not default to something valid.
+******************************************************************************/
+static Gb _PngSetTypeFile(Gimgio * const img)
+{
+   genter;
+
+   switch(img->typeFile)
+   {
+   case gimgioTypeBLACK | gimgioTypeB1:
+   case gimgioTypeBLACK | gimgioTypeB2:
+   case gimgioTypeBLACK | gimgioTypeB4:
+   case gimgioTypeBLACK | gimgioTypeN1:
+   case gimgioTypeBLACK | gimgioTypeN2:
+      // supported by PNG.
+      return gbTRUE; 
+   
+   case gimgioTypeBLACK | gimgioTypeN4:
+   case gimgioTypeBLACK | gimgioTypeR4:
+   case gimgioTypeBLACK | gimgioTypeR8:
+      img->typeFile = gimgioTypeBLACK | gimgioTypeN2;
+      return gbFALSE;
+
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB1:
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB2:
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeB4:
+      img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN1;
+      return gbFALSE;
+
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN1:
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2:
+      // supported by PNG.
+      return gbTRUE;
+
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN4:
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR4:
+   case gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeR8:
+      img->typeFile = gimgioTypeBLACK | gimgioTypeALPHA | gimgioTypeN2;
+      return gbFALSE;
+
+   case gimgioTypeRGB | gimgioTypeB1:
+   case gimgioTypeRGB | gimgioTypeB2:
+   case gimgioTypeRGB | gimgioTypeB4:
+      img->typeFile = gimgioTypeRGB | gimgioTypeN1;
+      return gbFALSE;
+
+   case gimgioTypeRGB | gimgioTypeN1:
+   case gimgioTypeRGB | gimgioTypeN2:
+      // supported by PNG.
+      return gbTRUE;
+
+   case gimgioTypeRGB | gimgioTypeN4:
+   case gimgioTypeRGB | gimgioTypeR4:
+   case gimgioTypeRGB | gimgioTypeR8:
+      img->typeFile = gimgioTypeRGB | gimgioTypeN2;
+      return gbFALSE;
+
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB1:
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB2:
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeB4:
+      img->typeFile = gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN1;
+      return gbFALSE;
+
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN1:
+      // supported by PNG.
+      return gbTRUE;
+
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN2:
+      // supported by PNG.
+      return gbTRUE;
+
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN4:
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeR4:
+   case gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeR8:
+      img->typeFile = gimgioTypeRGB | gimgioTypeALPHA | gimgioTypeN2;
+      return gbFALSE;
+   }
+
+   // Should never reach this.
+   img->typeFile = gimgioTypeRGB | gimgioTypeN1;
+   
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+func: _WritePng
+
+Finish the png file.  Rows never set are written as zeros.
+******************************************************************************/
+static Gb _WritePng(Gimgio * const img, Pngio * const data) 
+{
+   genter;
+
+   Gb   result;
+   Gn1 *row;
+
+   // No rows were set.  Still write out a proper file.
+   if (!data->pngIsEncoding)
+   {
+      greturnFalseIf(!_PngEncodeStart(img, data));
+   }
+   greturnFalseIf(!data->pngContext && !data->pngBandList);
+
+   result = gbTRUE;
+   while (data->pngRowCount < img->height)
+   {
+      row = NULL;
+      if (data->pngRowPending)
+      {
+         row = data->pngRowPending[data->pngRowCount];
+         data->pngRowPending[data->pngRowCount] = NULL;
+      }
+
+      if (!row)
+      {
+         gmemClear(data->pngRow, (Gcount) data->pngRowSize);
+      }
+
+      if (!_PngEncodeRow(img, data, row ? row : data->pngRow))
+      {
+         memioDestroyBuffer(img->memory, row);
+         result = gbFALSE;
+         break;
+      }
+
+      memioDestroyBuffer(img->memory, row);
+   }
+
+   // Rows held past a failure.
+   if (data->pngRowPending)
+   {
+      while (data->pngRowCount < img->height)
+      {
+         memioDestroyBuffer(img->memory, data->pngRowPending[data->pngRowCount]);
+         data->pngRowCount++;
+      }
+   }
+
+   greturn result;
 
 #if 0
    /* Allocate basic libpng structures */
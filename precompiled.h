@@ -22,6 +22,11 @@ include:
 // These are built in and do not require an external library.
 #include "bmpio.h"
 #include "grawio.h"
+#include "mapio.h"
+#include "memio.h"
+#include "simdio.h"
+#include "streamio.h"
+#include "taskio.h"
 
 #if defined(GIMGIO_JPG)
 #include "jpgio.h"
@@ -0,0 +1,818 @@
+/******************************************************************************
+
+file:       simdio.c
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Vectorized row kernels for the common pixel transforms.  RGB to RGBA, RGBA
+to RGB, BGR to RGB, 16 bit to 8 bit, 8 bit to 16 bit and gray to RGB.
+
+The kernel set is chosen once by simdioStart from what the CPU supports.
+The scalar versions are always available as the reference the vector
+versions need to match exactly.
+
+******************************************************************************/
+
+/******************************************************************************
+include:
+******************************************************************************/
+#include "precompiled.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#  define simdX86 1
+#  if defined(_MSC_VER)
+#     include <intrin.h>
+#  else
+#     include <cpuid.h>
+#  endif
+#  include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#  define simdNEON 1
+#  include <arm_neon.h>
+#endif
+
+/******************************************************************************
+local:
+type:
+******************************************************************************/
+// MSVC will compile any intrinsic.  GCC and clang need to be told per
+// function which instruction sets it may use.
+#if defined(simdX86) && !defined(_MSC_VER)
+#  define simdTARGET_SSE2  __attribute__((target("sse2")))
+#  define simdTARGET_SSSE3 __attribute__((target("ssse3")))
+#  define simdTARGET_AVX2  __attribute__((target("avx2")))
+#else
+#  define simdTARGET_SSE2
+#  define simdTARGET_SSSE3
+#  define simdTARGET_AVX2
+#endif
+
+/******************************************************************************
+variable:
+******************************************************************************/
+static SimdioLevel _level = simdioLevelSCALAR;
+
+static SimdioFunc  _func[simdioKernelCOUNT];
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+static SimdioLevel _GetLevelCpu(          void);
+
+static void        _BlackToRgbScalar(     Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N1ToN2Scalar(         Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N2ToN1Scalar(         Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbToRgbaScalar(      Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbaToRgbScalar(      Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _SwapRBScalar(         Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+#if defined(simdX86)
+static void        _N1ToN2Sse2(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N2ToN1Sse2(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+static void        _BlackToRgbSsse3(      Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbToRgbaSsse3(       Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbaToRgbSsse3(       Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _SwapRBSsse3(          Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+static void        _N1ToN2Avx2(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N2ToN1Avx2(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbToRgbaAvx2(        Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbaToRgbAvx2(        Gi4 const count, Gn1 const * const in, Gn1 * const out);
+#endif
+
+#if defined(simdNEON)
+static void        _BlackToRgbNeon(       Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N1ToN2Neon(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _N2ToN1Neon(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbToRgbaNeon(        Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _RgbaToRgbNeon(        Gi4 const count, Gn1 const * const in, Gn1 * const out);
+static void        _SwapRBNeon(           Gi4 const count, Gn1 const * const in, Gn1 * const out);
+#endif
+
+/******************************************************************************
+global: to library only
+function:
+******************************************************************************/
+/******************************************************************************
+func: simdioGetFunc
+
+Get the kernel for the level chosen in simdioStart.
+******************************************************************************/
+SimdioFunc simdioGetFunc(SimdioKernel const kernel)
+{
+   // simdioStart hasn't been called.
+   if (!_func[kernel])
+   {
+      return simdioGetFuncScalar(kernel);
+   }
+
+   return _func[kernel];
+}
+
+/******************************************************************************
+func: simdioGetFuncScalar
+
+Get the plain C version of a kernel.
+******************************************************************************/
+SimdioFunc simdioGetFuncScalar(SimdioKernel const kernel)
+{
+   switch (kernel)
+   {
+   case simdioKernelRGB_TO_RGBA:  return _RgbToRgbaScalar;
+   case simdioKernelRGBA_TO_RGB:  return _RgbaToRgbScalar;
+   case simdioKernelSWAP_RB:      return _SwapRBScalar;
+   case simdioKernelN2_TO_N1:     return _N2ToN1Scalar;
+   case simdioKernelN1_TO_N2:     return _N1ToN2Scalar;
+   case simdioKernelBLACK_TO_RGB: return _BlackToRgbScalar;
+   }
+
+   return NULL;
+}
+
+/******************************************************************************
+func: simdioGetLevel
+
+Get the instruction set in use.
+******************************************************************************/
+SimdioLevel simdioGetLevel(void)
+{
+   return _level;
+}
+
+/******************************************************************************
+func: simdioStart
+
+Pick the kernels.  levelMax limits what is used.  simdioLevelSCALAR forces
+the reference kernels.
+******************************************************************************/
+void simdioStart(SimdioLevel const levelMax)
+{
+   SimdioKernel kernel;
+
+   genter;
+
+   _level = _GetLevelCpu();
+   if (levelMax != simdioLevelMAX &&
+       levelMax <  _level)
+   {
+      _level = levelMax;
+   }
+
+   forCount(kernel, simdioKernelCOUNT)
+   {
+      _func[kernel] = simdioGetFuncScalar(kernel);
+   }
+
+#if defined(simdX86)
+   if (_level >= simdioLevelSSE2)
+   {
+      _func[simdioKernelN2_TO_N1]     = _N2ToN1Sse2;
+      _func[simdioKernelN1_TO_N2]     = _N1ToN2Sse2;
+   }
+   if (_level >= simdioLevelSSSE3)
+   {
+      _func[simdioKernelRGB_TO_RGBA]  = _RgbToRgbaSsse3;
+      _func[simdioKernelRGBA_TO_RGB]  = _RgbaToRgbSsse3;
+      _func[simdioKernelSWAP_RB]      = _SwapRBSsse3;
+      _func[simdioKernelBLACK_TO_RGB] = _BlackToRgbSsse3;
+   }
+   if (_level >= simdioLevelAVX2)
+   {
+      _func[simdioKernelRGB_TO_RGBA]  = _RgbToRgbaAvx2;
+      _func[simdioKernelRGBA_TO_RGB]  = _RgbaToRgbAvx2;
+      _func[simdioKernelN2_TO_N1]     = _N2ToN1Avx2;
+      _func[simdioKernelN1_TO_N2]     = _N1ToN2Avx2;
+   }
+#endif
+
+#if defined(simdNEON)
+   if (_level == simdioLevelNEON)
+   {
+      _func[simdioKernelRGB_TO_RGBA]  = _RgbToRgbaNeon;
+      _func[simdioKernelRGBA_TO_RGB]  = _RgbaToRgbNeon;
+      _func[simdioKernelSWAP_RB]      = _SwapRBNeon;
+      _func[simdioKernelN2_TO_N1]     = _N2ToN1Neon;
+      _func[simdioKernelN1_TO_N2]     = _N1ToN2Neon;
+      _func[simdioKernelBLACK_TO_RGB] = _BlackToRgbNeon;
+   }
+#endif
+
+   greturn;
+}
+
+/******************************************************************************
+local:
+function:
+******************************************************************************/
+/******************************************************************************
+func: _GetLevelCpu
+
+Find out what the CPU supports.
+******************************************************************************/
+static SimdioLevel _GetLevelCpu(void)
+{
+#if defined(simdX86)
+   unsigned int eax, ebx, ecx, edx;
+   Gn8          xcr0;
+   SimdioLevel  level;
+
+#if defined(_MSC_VER)
+   int info[4];
+
+   __cpuid(info, 0);
+   eax = (unsigned int) info[0];
+   if (eax < 1)
+   {
+      return simdioLevelSCALAR;
+   }
+
+   __cpuid(info, 1);
+   ecx = (unsigned int) info[2];
+   edx = (unsigned int) info[3];
+#else
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+   {
+      return simdioLevelSCALAR;
+   }
+#endif
+
+   level = simdioLevelSCALAR;
+
+   // SSE2
+   if (!(edx & (1 << 26)))
+   {
+      return level;
+   }
+   level = simdioLevelSSE2;
+
+   // SSSE3
+   if (!(ecx & (1 << 9)))
+   {
+      return level;
+   }
+   level = simdioLevelSSSE3;
+
+   // AVX2 also needs the OS to save the ymm registers.  OSXSAVE and AVX.
+   if (!(ecx & (1 << 27)) ||
+       !(ecx & (1 << 28)))
+   {
+      return level;
+   }
+
+#if defined(_MSC_VER)
+   xcr0 = (Gn8) _xgetbv(0);
+
+   __cpuidex(info, 7, 0);
+   ebx = (unsigned int) info[1];
+#else
+   {
+      unsigned int xlo, xhi;
+
+      __asm__ volatile ("xgetbv" : "=a" (xlo), "=d" (xhi) : "c" (0));
+      xcr0 = ((Gn8) xhi << 32) | xlo;
+   }
+
+   if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+   {
+      return level;
+   }
+#endif
+
+   if ((xcr0 & 6) == 6 &&
+       (ebx & (1 << 5)))
+   {
+      level = simdioLevelAVX2;
+   }
+
+   return level;
+
+#elif defined(simdNEON)
+   // Always present on 64 bit ARM.
+   return simdioLevelNEON;
+
+#else
+   return simdioLevelSCALAR;
+#endif
+}
+
+/******************************************************************************
+func: _BlackToRgbScalar
+
+Gray to RGB.  count is in pixels.
+******************************************************************************/
+static void _BlackToRgbScalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   forCount(index, count)
+   {
+      out[index * 3 + 0] =
+         out[index * 3 + 1] =
+         out[index * 3 + 2] = in[index];
+   }
+}
+
+/******************************************************************************
+func: _N1ToN2Scalar
+
+Widen 8 bit channels to 16 bit.  count is in channel values.
+******************************************************************************/
+static void _N1ToN2Scalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4  index;
+   Gn2 *n2;
+
+   n2 = (Gn2 *) out;
+
+   forCount(index, count)
+   {
+      n2[index] = N4ToN2(N1ToN4(in[index]));
+   }
+}
+
+/******************************************************************************
+func: _N2ToN1Scalar
+
+Narrow 16 bit channels to 8 bit.  count is in channel values.
+******************************************************************************/
+static void _N2ToN1Scalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4        index;
+   Gn2 const *n2;
+
+   n2 = (Gn2 const *) in;
+
+   forCount(index, count)
+   {
+      out[index] = (Gn1) (n2[index] >> 8);
+   }
+}
+
+/******************************************************************************
+func: _RgbToRgbaScalar
+
+RGB to RGBA with an opaque alpha.  count is in pixels.
+******************************************************************************/
+static void _RgbToRgbaScalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   forCount(index, count)
+   {
+      out[index * 4 + 0] = in[index * 3 + 0];
+      out[index * 4 + 1] = in[index * 3 + 1];
+      out[index * 4 + 2] = in[index * 3 + 2];
+      out[index * 4 + 3] = 0xff;
+   }
+}
+
+/******************************************************************************
+func: _RgbaToRgbScalar
+
+RGBA to RGB, alpha is dropped.  count is in pixels.
+******************************************************************************/
+static void _RgbaToRgbScalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   forCount(index, count)
+   {
+      out[index * 3 + 0] = in[index * 4 + 0];
+      out[index * 3 + 1] = in[index * 4 + 1];
+      out[index * 3 + 2] = in[index * 4 + 2];
+   }
+}
+
+/******************************************************************************
+func: _SwapRBScalar
+
+BGR to RGB or RGB to BGR.  count is in pixels.  in and out may be the same.
+******************************************************************************/
+static void _SwapRBScalar(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+   Gn1 r,
+       b;
+
+   forCount(index, count)
+   {
+      r                  = in[index * 3 + 2];
+      b                  = in[index * 3 + 0];
+      out[index * 3 + 0] = r;
+      out[index * 3 + 1] = in[index * 3 + 1];
+      out[index * 3 + 2] = b;
+   }
+}
+
+#if defined(simdX86)
+/******************************************************************************
+func: _N1ToN2Sse2
+
+Widen 8 bit channels to 16 bit.  v becomes v << 8 like the scalar version.
+******************************************************************************/
+simdTARGET_SSE2
+static void _N1ToN2Sse2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m128i zero,
+           v;
+
+   zero = _mm_setzero_si128();
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      v = _mm_loadu_si128((__m128i const *) &in[index]);
+      _mm_storeu_si128((__m128i *) &out[index * 2],      _mm_unpacklo_epi8(zero, v));
+      _mm_storeu_si128((__m128i *) &out[index * 2 + 16], _mm_unpackhi_epi8(zero, v));
+   }
+
+   _N1ToN2Scalar(count - index, &in[index], &out[index * 2]);
+}
+
+/******************************************************************************
+func: _N2ToN1Sse2
+
+Narrow 16 bit channels to 8 bit, keeping the high byte.
+******************************************************************************/
+simdTARGET_SSE2
+static void _N2ToN1Sse2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m128i a,
+           b;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      a = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) &in[index * 2]),      8);
+      b = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) &in[index * 2 + 16]), 8);
+      _mm_storeu_si128((__m128i *) &out[index], _mm_packus_epi16(a, b));
+   }
+
+   _N2ToN1Scalar(count - index, &in[index * 2], &out[index]);
+}
+
+/******************************************************************************
+func: _BlackToRgbSsse3
+
+Gray to RGB.  16 pixels per step.
+******************************************************************************/
+simdTARGET_SSSE3
+static void _BlackToRgbSsse3(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m128i v,
+           mask0,
+           mask1,
+           mask2;
+
+   mask0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+   mask1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+   mask2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      v = _mm_loadu_si128((__m128i const *) &in[index]);
+      _mm_storeu_si128((__m128i *) &out[index * 3],      _mm_shuffle_epi8(v, mask0));
+      _mm_storeu_si128((__m128i *) &out[index * 3 + 16], _mm_shuffle_epi8(v, mask1));
+      _mm_storeu_si128((__m128i *) &out[index * 3 + 32], _mm_shuffle_epi8(v, mask2));
+   }
+
+   _BlackToRgbScalar(count - index, &in[index], &out[index * 3]);
+}
+
+/******************************************************************************
+func: _RgbToRgbaSsse3
+
+RGB to RGBA.  4 pixels per step.  The load reads 16 bytes for 12 so the
+loop stops early enough to stay inside the row.
+******************************************************************************/
+simdTARGET_SSSE3
+static void _RgbToRgbaSsse3(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m128i v,
+           mask,
+           alpha;
+
+   mask  = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+   alpha = _mm_set1_epi32((int) 0xff000000);
+
+   for (index = 0; index + 6 <= count; index += 4)
+   {
+      v = _mm_loadu_si128((__m128i const *) &in[index * 3]);
+      v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+      _mm_storeu_si128((__m128i *) &out[index * 4], v);
+   }
+
+   _RgbToRgbaScalar(count - index, &in[index * 3], &out[index * 4]);
+}
+
+/******************************************************************************
+func: _RgbaToRgbSsse3
+
+RGBA to RGB.  4 pixels per step, 12 bytes stored as 8 + 4.
+******************************************************************************/
+simdTARGET_SSSE3
+static void _RgbaToRgbSsse3(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   Gi4     tail;
+   __m128i v,
+           mask;
+
+   mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+   for (index = 0; index + 4 <= count; index += 4)
+   {
+      v    = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) &in[index * 4]), mask);
+      tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+      _mm_storel_epi64((__m128i *) &out[index * 3], v);
+      memcpy(&out[index * 3 + 8], &tail, 4);
+   }
+
+   _RgbaToRgbScalar(count - index, &in[index * 4], &out[index * 3]);
+}
+
+/******************************************************************************
+func: _SwapRBSsse3
+
+BGR to RGB.  5 pixels per step.  The 16th byte is written as is and then
+overwritten by the next step or the scalar tail.
+******************************************************************************/
+simdTARGET_SSSE3
+static void _SwapRBSsse3(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m128i v,
+           mask;
+
+   mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+
+   for (index = 0; index + 6 <= count; index += 5)
+   {
+      v = _mm_loadu_si128((__m128i const *) &in[index * 3]);
+      _mm_storeu_si128((__m128i *) &out[index * 3], _mm_shuffle_epi8(v, mask));
+   }
+
+   _SwapRBScalar(count - index, &in[index * 3], &out[index * 3]);
+}
+
+/******************************************************************************
+func: _N1ToN2Avx2
+
+Widen 8 bit channels to 16 bit.  32 values per step.
+******************************************************************************/
+simdTARGET_AVX2
+static void _N1ToN2Avx2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m256i v,
+           zero,
+           lo,
+           hi;
+
+   zero = _mm256_setzero_si256();
+
+   for (index = 0; index + 32 <= count; index += 32)
+   {
+      // Unpack works per 128 bit lane, put the lanes back in order.
+      v  = _mm256_permute4x64_epi64(_mm256_loadu_si256((__m256i const *) &in[index]), 0xd8);
+      lo = _mm256_unpacklo_epi8(zero, v);
+      hi = _mm256_unpackhi_epi8(zero, v);
+      _mm256_storeu_si256((__m256i *) &out[index * 2],      lo);
+      _mm256_storeu_si256((__m256i *) &out[index * 2 + 32], hi);
+   }
+
+   _N1ToN2Sse2(count - index, &in[index], &out[index * 2]);
+}
+
+/******************************************************************************
+func: _N2ToN1Avx2
+
+Narrow 16 bit channels to 8 bit.  32 values per step.
+******************************************************************************/
+simdTARGET_AVX2
+static void _N2ToN1Avx2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m256i a,
+           b;
+
+   for (index = 0; index + 32 <= count; index += 32)
+   {
+      a = _mm256_srli_epi16(_mm256_loadu_si256((__m256i const *) &in[index * 2]),      8);
+      b = _mm256_srli_epi16(_mm256_loadu_si256((__m256i const *) &in[index * 2 + 32]), 8);
+      // Pack works per 128 bit lane, put the lanes back in order.
+      _mm256_storeu_si256(
+         (__m256i *) &out[index],
+         _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+   }
+
+   _N2ToN1Sse2(count - index, &in[index * 2], &out[index]);
+}
+
+/******************************************************************************
+func: _RgbToRgbaAvx2
+
+RGB to RGBA.  8 pixels per step, 12 bytes loaded into each lane.
+******************************************************************************/
+simdTARGET_AVX2
+static void _RgbToRgbaAvx2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   __m256i v,
+           mask,
+           alpha;
+
+   mask  = _mm256_setr_epi8(
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+   alpha = _mm256_set1_epi32((int) 0xff000000);
+
+   for (index = 0; index + 10 <= count; index += 8)
+   {
+      v = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(_mm_loadu_si128((__m128i const *) &in[index * 3])),
+         _mm_loadu_si128((__m128i const *) &in[index * 3 + 12]),
+         1);
+      v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+      _mm256_storeu_si256((__m256i *) &out[index * 4], v);
+   }
+
+   _RgbToRgbaSsse3(count - index, &in[index * 3], &out[index * 4]);
+}
+
+/******************************************************************************
+func: _RgbaToRgbAvx2
+
+RGBA to RGB.  8 pixels per step, each lane holds 12 bytes of result.
+******************************************************************************/
+simdTARGET_AVX2
+static void _RgbaToRgbAvx2(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4     index;
+   Gi4     tail;
+   __m256i v,
+           mask;
+   __m128i lo,
+           hi;
+
+   mask = _mm256_setr_epi8(
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+   for (index = 0; index + 8 <= count; index += 8)
+   {
+      v  = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i const *) &in[index * 4]), mask);
+      lo = _mm256_castsi256_si128(v);
+      hi = _mm256_extracti128_si256(v, 1);
+
+      _mm_storel_epi64((__m128i *) &out[index * 3], lo);
+      tail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+      memcpy(&out[index * 3 + 8], &tail, 4);
+
+      _mm_storel_epi64((__m128i *) &out[index * 3 + 12], hi);
+      tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+      memcpy(&out[index * 3 + 20], &tail, 4);
+   }
+
+   _RgbaToRgbSsse3(count - index, &in[index * 4], &out[index * 3]);
+}
+#endif
+
+#if defined(simdNEON)
+/******************************************************************************
+func: _BlackToRgbNeon
+
+Gray to RGB.  16 pixels per step.
+******************************************************************************/
+static void _BlackToRgbNeon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4          index;
+   uint8x16x3_t rgb;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      rgb.val[0] =
+         rgb.val[1] =
+         rgb.val[2] = vld1q_u8(&in[index]);
+      vst3q_u8(&out[index * 3], rgb);
+   }
+
+   _BlackToRgbScalar(count - index, &in[index], &out[index * 3]);
+}
+
+/******************************************************************************
+func: _N1ToN2Neon
+
+Widen 8 bit channels to 16 bit.  16 values per step.
+******************************************************************************/
+static void _N1ToN2Neon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4        index;
+   uint8x16_t v;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      v = vld1q_u8(&in[index]);
+      vst1q_u16((uint16_t *) &out[index * 2],      vshll_n_u8(vget_low_u8( v), 8));
+      vst1q_u16((uint16_t *) &out[index * 2 + 16], vshll_n_u8(vget_high_u8(v), 8));
+   }
+
+   _N1ToN2Scalar(count - index, &in[index], &out[index * 2]);
+}
+
+/******************************************************************************
+func: _N2ToN1Neon
+
+Narrow 16 bit channels to 8 bit.  16 values per step.
+******************************************************************************/
+static void _N2ToN1Neon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4 index;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      vst1q_u8(
+         &out[index],
+         vcombine_u8(
+            vshrn_n_u16(vld1q_u16((uint16_t const *) &in[index * 2]),      8),
+            vshrn_n_u16(vld1q_u16((uint16_t const *) &in[index * 2 + 16]), 8)));
+   }
+
+   _N2ToN1Scalar(count - index, &in[index * 2], &out[index]);
+}
+
+/******************************************************************************
+func: _RgbToRgbaNeon
+
+RGB to RGBA.  16 pixels per step.
+******************************************************************************/
+static void _RgbToRgbaNeon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4          index;
+   uint8x16x3_t rgb;
+   uint8x16x4_t rgba;
+
+   rgba.val[3] = vdupq_n_u8(0xff);
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      rgb         = vld3q_u8(&in[index * 3]);
+      rgba.val[0] = rgb.val[0];
+      rgba.val[1] = rgb.val[1];
+      rgba.val[2] = rgb.val[2];
+      vst4q_u8(&out[index * 4], rgba);
+   }
+
+   _RgbToRgbaScalar(count - index, &in[index * 3], &out[index * 4]);
+}
+
+/******************************************************************************
+func: _RgbaToRgbNeon
+
+RGBA to RGB.  16 pixels per step.
+******************************************************************************/
+static void _RgbaToRgbNeon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4          index;
+   uint8x16x3_t rgb;
+   uint8x16x4_t rgba;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      rgba       = vld4q_u8(&in[index * 4]);
+      rgb.val[0] = rgba.val[0];
+      rgb.val[1] = rgba.val[1];
+      rgb.val[2] = rgba.val[2];
+      vst3q_u8(&out[index * 3], rgb);
+   }
+
+   _RgbaToRgbScalar(count - index, &in[index * 4], &out[index * 3]);
+}
+
+/******************************************************************************
+func: _SwapRBNeon
+
+BGR to RGB.  16 pixels per step.
+******************************************************************************/
+static void _SwapRBNeon(Gi4 const count, Gn1 const * const in, Gn1 * const out)
+{
+   Gi4          index;
+   uint8x16x3_t rgb;
+   uint8x16_t   t;
+
+   for (index = 0; index + 16 <= count; index += 16)
+   {
+      rgb        = vld3q_u8(&in[index * 3]);
+      t          = rgb.val[0];
+      rgb.val[0] = rgb.val[2];
+      rgb.val[2] = t;
+      vst3q_u8(&out[index * 3], rgb);
+   }
+
+   _SwapRBScalar(count - index, &in[index * 3], &out[index * 3]);
+}
+#endif
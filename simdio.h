@@ -0,0 +1,52 @@
+/******************************************************************************
+
+file:       simdio.h
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Vectorized row kernels for the common pixel transforms.
+
+******************************************************************************/
+
+/******************************************************************************
+constant:
+******************************************************************************/
+typedef enum
+{
+   simdioKernelRGB_TO_RGBA,
+   simdioKernelRGBA_TO_RGB,
+   simdioKernelSWAP_RB,
+   simdioKernelN2_TO_N1,
+   simdioKernelN1_TO_N2,
+   simdioKernelBLACK_TO_RGB,
+
+   simdioKernelCOUNT
+} SimdioKernel;
+
+typedef enum
+{
+   simdioLevelSCALAR,
+   simdioLevelSSE2,
+   simdioLevelSSSE3,
+   simdioLevelAVX2,
+   simdioLevelNEON,
+
+   simdioLevelMAX
+} SimdioLevel;
+
+/******************************************************************************
+type:
+******************************************************************************/
+// count is in pixels for the channel kernels and in channel values for the
+// channel size kernels.  All are for N1 channels unless named otherwise.
+typedef void (*SimdioFunc)(Gi4 const count, Gn1 const * const in, Gn1 * const out);
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+SimdioFunc  simdioGetFunc(       SimdioKernel const kernel);
+SimdioFunc  simdioGetFuncScalar( SimdioKernel const kernel);
+SimdioLevel simdioGetLevel(      void);
+
+void        simdioStart(         SimdioLevel const levelMax);
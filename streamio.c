@@ -0,0 +1,572 @@
+/******************************************************************************
+
+file:       streamio.c
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Where the codecs get and put their bytes.  Positions are always from the 
+start.  A caller's stream without SetPosition can still go forward by 
+reading and dropping bytes, and a peek is kept to the side so the format
+can be found without going back.
+
+******************************************************************************/
+
+/******************************************************************************
+include:
+******************************************************************************/
+#include "precompiled.h"
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+/******************************************************************************
+local:
+constant:
+******************************************************************************/
+// Most a streamioPeek can look ahead.
+#define streamioPeekMAX    64
+
+// Smallest IO buffer streamioSetBufferSize allows.
+#define streamioBufferSizeMIN  4096
+
+typedef enum
+{
+   streamioSourceFILE,
+   streamioSourceMEMORY,
+   streamioSourceSTREAM
+} StreamioSource;
+
+/******************************************************************************
+type:
+******************************************************************************/
+struct Streamio
+{
+   StreamioSource     source;
+   Gfile             *file;
+   // Files read.  Mapped the first time streamioGetMemory asks for it.
+   Gs                *path;
+   Mapio             *map;
+   Gb                 isMapTried;
+   Gn1 const         *buffer;
+   Gsize              count;
+   GimgioStream       stream;
+   // Memory and caller streams.  Bytes handed out so far.
+   GfileIndex         position;
+   // Caller streams without SetPosition.  Bytes peeked at but not handed
+   // out yet.
+   Gn1                peek[streamioPeekMAX];
+   Gcount             peekCount;
+   Gindex             peekIndex;
+};
+
+/******************************************************************************
+variable:
+******************************************************************************/
+static Gsize _bufferSize = gimgioBufferSIZE;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+static Gb   _FileClear(Gpath const * const path);
+
+/******************************************************************************
+global: to library only
+function:
+******************************************************************************/
+/******************************************************************************
+func: streamioCreateFile
+
+Open a file.  Read only for gimgioOpenREAD, read and write otherwise.  A 
+file opened for writing is emptied once it is open.
+******************************************************************************/
+Streamio *streamioCreateFile(Gpath const * const path, GimgioOpenMode const mode)
+{
+   genter;
+
+   Streamio *stream;
+
+   greturnNullIf(!path);
+
+   stream = memioCreateType(NULL, Streamio);
+   greturnNullIf(!stream);
+
+   stream->source = streamioSourceFILE;
+   stream->file   = gfileOpen(
+      path, 
+      (mode == gimgioOpenREAD) ? gfileOpenModeREAD_ONLY : gfileOpenModeREAD_WRITE);
+   if (!stream->file)
+   {
+      memioDestroyBuffer(NULL, stream);
+      greturn NULL;
+   }
+
+   // A brand new file.  Nothing of an older, longer one may be left past 
+   // the end of what is written.  Only once the open worked so a failed 
+   // open leaves the file alone.
+   if (mode == gimgioOpenWRITE &&
+       !_FileClear(path))
+   {
+      gfileClose(stream->file);
+      memioDestroyBuffer(NULL, stream);
+      greturn NULL;
+   }
+
+   if (mode == gimgioOpenREAD)
+   {
+      stream->path = gsCreateFrom(path);
+   }
+
+   greturn stream;
+}
+
+/******************************************************************************
+func: streamioCreateMemory
+
+Read from a buffer.  The buffer is not copied so it has to stay until the 
+stream is destroyed.
+******************************************************************************/
+Streamio *streamioCreateMemory(void const * const buffer, Gsize const count)
+{
+   genter;
+
+   Streamio *stream;
+
+   greturnNullIf(!buffer);
+
+   stream = memioCreateType(NULL, Streamio);
+   greturnNullIf(!stream);
+
+   stream->source = streamioSourceMEMORY;
+   stream->buffer = (Gn1 const *) buffer;
+   stream->count  = count;
+
+   greturn stream;
+}
+
+/******************************************************************************
+func: streamioCreateStream
+
+Use the caller's stream.
+******************************************************************************/
+Streamio *streamioCreateStream(GimgioStream const * const streamCaller)
+{
+   genter;
+
+   Streamio *stream;
+
+   greturnNullIf(
+      !streamCaller ||
+      (!streamCaller->Get && 
+       !streamCaller->Set));
+
+   stream = memioCreateType(NULL, Streamio);
+   greturnNullIf(!stream);
+
+   stream->source = streamioSourceSTREAM;
+   stream->stream = *streamCaller;
+
+   greturn stream;
+}
+
+/******************************************************************************
+func: streamioDestroy
+
+Close the file if there is one.
+******************************************************************************/
+void streamioDestroy(Streamio * const stream)
+{
+   genter;
+
+   greturnVoidIf(!stream);
+
+   if (stream->source == streamioSourceFILE)
+   {
+      mapioDestroy(stream->map);
+      gsDestroy(stream->path);
+      gfileClose(stream->file);
+   }
+
+   memioDestroyBuffer(NULL, stream);
+
+   greturn;
+}
+
+/******************************************************************************
+func: streamioGet
+
+Read up to count bytes.  Returns the count read.
+******************************************************************************/
+Gcount streamioGet(Streamio * const stream, Gcount const count, void * const buffer)
+{
+   genter;
+
+   Gcount countPeek;
+   Gcount countRead;
+
+   greturnIf(
+      !stream ||
+      count <= 0, 
+      0);
+
+   switch (stream->source)
+   {
+   case streamioSourceFILE:
+      greturn gfileGet(stream->file, count, buffer);
+
+   case streamioSourceMEMORY:
+      greturnIf(stream->position >= (GfileIndex) stream->count, 0);
+
+      countRead = (Gcount) gMIN((Gsize) count, stream->count - (Gsize) stream->position);
+      memcpy(buffer, &stream->buffer[stream->position], (size_t) countRead);
+      stream->position += countRead;
+
+      greturn countRead;
+
+   case streamioSourceSTREAM:
+      greturnIf(!stream->stream.Get, 0);
+
+      // What was peeked at goes first.
+      countPeek = gMIN(count, stream->peekCount - stream->peekIndex);
+      memcpy(buffer, &stream->peek[stream->peekIndex], (size_t) countPeek);
+      stream->peekIndex += countPeek;
+
+      countRead = 0;
+      if (countPeek < count)
+      {
+         countRead = stream->stream.Get(
+            stream->stream.user, 
+            count - countPeek, 
+            (Gn1 *) buffer + countPeek);
+         countRead = gMAX(0, countRead);
+      }
+
+      stream->position += countPeek + countRead;
+
+      greturn countPeek + countRead;
+   }
+
+   greturn 0;
+}
+
+/******************************************************************************
+func: streamioGetBufferSize
+
+Get how big the codecs make their IO buffers.
+******************************************************************************/
+Gsize streamioGetBufferSize(void)
+{
+   genter;
+   greturn _bufferSize;
+}
+
+/******************************************************************************
+func: streamioGetMemory
+
+Get all the bytes of the source at once, without copying, when they are in
+memory.  A file being read is mapped for this.  NULL when the source can't
+do it, reading goes through streamioGet then.  The bytes stay until the 
+stream is destroyed.  count gets how many there are, from the start.
+******************************************************************************/
+Gn1 const *streamioGetMemory(Streamio * const stream, GfileIndex * const count)
+{
+   genter;
+
+   *count = 0;
+
+   greturnNullIf(!stream);
+
+   switch (stream->source)
+   {
+   case streamioSourceFILE:
+      greturnNullIf(!stream->path);
+
+      if (!stream->isMapTried)
+      {
+         stream->isMapTried = gbTRUE;
+         stream->map        = mapioCreate(stream->path);
+      }
+      greturnNullIf(!stream->map);
+
+      *count = mapioGetCount(stream->map);
+
+      greturn mapioGetBuffer(stream->map);
+
+   case streamioSourceMEMORY:
+      *count = (GfileIndex) stream->count;
+
+      greturn stream->buffer;
+
+   case streamioSourceSTREAM:
+      break;
+   }
+
+   greturn NULL;
+}
+
+/******************************************************************************
+func: streamioGetPosition
+
+Get the position from the start.
+******************************************************************************/
+GfileIndex streamioGetPosition(Streamio const * const stream)
+{
+   genter;
+
+   greturnIf(!stream, 0);
+
+   greturnIf(stream->source == streamioSourceFILE, gfileGetPosition(stream->file));
+
+   greturn stream->position;
+}
+
+/******************************************************************************
+func: streamioPeek
+
+Look at the next count bytes without moving on.  At most streamioPeekMAX.
+Returns the count there was.
+******************************************************************************/
+Gcount streamioPeek(Streamio * const stream, Gcount const count, void * const buffer)
+{
+   genter;
+
+   GfileIndex position;
+   Gcount     countRead;
+
+   greturnIf(
+      !stream ||
+      count <= 0 ||
+      count >  streamioPeekMAX,
+      0);
+
+   // Caller streams that can't go back keep what they read to the side.
+   if (stream->source == streamioSourceSTREAM &&
+       !stream->stream.SetPosition)
+   {
+      greturnIf(!stream->stream.Get, 0);
+
+      // Drop what has been handed out already and top up.
+      memmove(stream->peek, &stream->peek[stream->peekIndex], (size_t) (stream->peekCount - stream->peekIndex));
+      stream->peekCount -= stream->peekIndex;
+      stream->peekIndex  = 0;
+
+      while (stream->peekCount < count)
+      {
+         countRead = stream->stream.Get(
+            stream->stream.user, 
+            count - stream->peekCount, 
+            &stream->peek[stream->peekCount]);
+         breakIf(countRead <= 0);
+
+         stream->peekCount += countRead;
+      }
+
+      countRead = gMIN(count, stream->peekCount);
+      memcpy(buffer, stream->peek, (size_t) countRead);
+
+      greturn countRead;
+   }
+
+   position  = streamioGetPosition(stream);
+   countRead = streamioGet(stream, count, buffer);
+   greturnIf(!streamioSetPosition(stream, position), 0);
+
+   greturn countRead;
+}
+
+/******************************************************************************
+func: streamioSetAdvice
+
+Tell the OS how the bytes from streamioGetMemory will be read.  Only means 
+something for a mapped file.
+******************************************************************************/
+void streamioSetAdvice(Streamio * const stream, MapioAdvice const advice)
+{
+   genter;
+
+   greturnVoidIf(
+      !stream ||
+      !stream->map);
+
+   mapioSetAdvice(stream->map, advice);
+
+   greturn;
+}
+
+/******************************************************************************
+func: streamioSet
+
+Write all count bytes.
+******************************************************************************/
+Gb streamioSet(Streamio * const stream, Gcount const count, void const * const buffer)
+{
+   genter;
+
+   greturnFalseIf(!stream);
+   greturnTrueIf(count <= 0);
+
+   switch (stream->source)
+   {
+   case streamioSourceFILE:
+      greturn gfileSet(stream->file, count, buffer, NULL);
+
+   case streamioSourceMEMORY:
+      // Memory is read only.
+      greturn gbFALSE;
+
+   case streamioSourceSTREAM:
+      greturnFalseIf(
+         !stream->stream.Set ||
+         !stream->stream.Set(stream->stream.user, count, buffer));
+
+      stream->position += count;
+
+      greturn gbTRUE;
+   }
+
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+func: streamioSetBufferSize
+
+Set how big the codecs make their IO buffers.  Buffers already out keep 
+their size.
+******************************************************************************/
+void streamioSetBufferSize(Gsize const size)
+{
+   genter;
+
+   _bufferSize = gMAX(size, streamioBufferSizeMIN);
+
+   greturn;
+}
+
+/******************************************************************************
+func: streamioSetPosition
+
+Go to a position from the start.  A caller's stream without SetPosition 
+can only go forward, and only when reading.
+******************************************************************************/
+Gb streamioSetPosition(Streamio * const stream, GfileIndex const position)
+{
+   genter;
+
+   Gn1    buffer[4096];
+   Gcount count;
+
+   greturnFalseIf(
+      !stream ||
+      position < 0);
+
+   switch (stream->source)
+   {
+   case streamioSourceFILE:
+      greturn gfileSetPosition(stream->file, gpositionSTART, position);
+
+   case streamioSourceMEMORY:
+      greturnFalseIf(position > (GfileIndex) stream->count);
+
+      stream->position = position;
+
+      greturn gbTRUE;
+
+   case streamioSourceSTREAM:
+      greturnTrueIf(position == stream->position);
+
+      if (stream->stream.SetPosition)
+      {
+         greturnFalseIf(!stream->stream.SetPosition(stream->stream.user, position));
+
+         stream->position  = position;
+         stream->peekCount = 0;
+         stream->peekIndex = 0;
+
+         greturn gbTRUE;
+      }
+
+      // Read up to the position.
+      greturnFalseIf(
+         position < stream->position ||
+         !stream->stream.Get);
+
+      while (stream->position < position)
+      {
+         count = (Gcount) gMIN((GfileIndex) sizeof(buffer), position - stream->position);
+         greturnFalseIf(streamioGet(stream, count, buffer) != count);
+      }
+
+      greturn gbTRUE;
+   }
+
+   greturn gbFALSE;
+}
+
+/******************************************************************************
+local:
+function:
+******************************************************************************/
+/******************************************************************************
+func: _FileClear
+
+Cut an open file down to nothing.  Gfile doesn't hand out its handle so the
+file is opened again next to it.
+******************************************************************************/
+static Gb _FileClear(Gpath const * const path)
+{
+   genter;
+
+   Char *name;
+   Gb    result;
+
+   name = gsCreateA(path);
+   greturnFalseIf(!name);
+
+   result = gbFALSE;
+
+#if defined(_WIN32)
+   {
+      HANDLE        file;
+      LARGE_INTEGER start;
+
+      file = CreateFileA(
+         name, 
+         GENERIC_WRITE, 
+         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 
+         NULL, 
+         OPEN_EXISTING, 
+         FILE_ATTRIBUTE_NORMAL, 
+         NULL);
+      if (file != INVALID_HANDLE_VALUE)
+      {
+         start.QuadPart = 0;
+         result         = 
+            SetFilePointerEx(file, start, NULL, FILE_BEGIN) &&
+            SetEndOfFile(file);
+
+         CloseHandle(file);
+      }
+   }
+#else
+   {
+      int file;
+
+      file = open(name, O_WRONLY);
+      if (file >= 0)
+      {
+         result = (ftruncate(file, 0) == 0);
+
+         close(file);
+      }
+   }
+#endif
+
+   gmemDestroy(name);
+
+   greturn result;
+}
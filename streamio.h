@@ -0,0 +1,37 @@
+/******************************************************************************
+
+file:       streamio.h
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Where the codecs get and put their bytes.  A file, a buffer in memory or 
+the caller's own stream.
+
+******************************************************************************/
+
+/******************************************************************************
+type:
+******************************************************************************/
+typedef struct Streamio Streamio;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+Streamio   *streamioCreateFile(   Gpath const * const path, GimgioOpenMode const mode);
+Streamio   *streamioCreateMemory( void const * const buffer, Gsize const count);
+Streamio   *streamioCreateStream( GimgioStream const * const stream);
+
+void        streamioDestroy(      Streamio * const stream);
+
+Gcount      streamioGet(          Streamio * const stream, Gcount const count, void * const buffer);
+Gsize       streamioGetBufferSize(void);
+Gn1 const  *streamioGetMemory(    Streamio * const stream, GfileIndex * const count);
+GfileIndex  streamioGetPosition(  Streamio const * const stream);
+
+Gcount      streamioPeek(         Streamio * const stream, Gcount const count, void * const buffer);
+
+Gb          streamioSet(          Streamio * const stream, Gcount const count, void const * const buffer);
+void        streamioSetAdvice(    Streamio * const stream, MapioAdvice const advice);
+void        streamioSetBufferSize(Gsize const size);
+Gb          streamioSetPosition(  Streamio * const stream, GfileIndex const position);
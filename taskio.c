@@ -0,0 +1,457 @@
+/******************************************************************************
+
+file:       taskio.c
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Threads, locks and signals.  Thin layer over the OS so the codecs don't have
+to care which one they are on.
+
+******************************************************************************/
+
+/******************************************************************************
+include:
+******************************************************************************/
+#include "precompiled.h"
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+/******************************************************************************
+local:
+constant:
+******************************************************************************/
+// No point in more threads than this in one taskioRun.
+#define taskioRunThreadMAX 256
+
+/******************************************************************************
+type:
+******************************************************************************/
+struct TaskioLock
+{
+#if defined(_WIN32)
+   SRWLOCK            lock;
+#else
+   pthread_mutex_t    lock;
+#endif
+};
+
+struct TaskioSignal
+{
+#if defined(_WIN32)
+   CONDITION_VARIABLE signal;
+#else
+   pthread_cond_t     signal;
+#endif
+};
+
+struct TaskioThread
+{
+#if defined(_WIN32)
+   HANDLE             thread;
+#else
+   pthread_t          thread;
+#endif
+   TaskioThreadFunc   func;
+   void              *data;
+};
+
+// Shared by the threads of one taskioRun.
+typedef struct
+{
+   TaskioLock        *lock;
+   Gindex             index;
+   Gcount             count;
+   TaskioRunFunc      func;
+   void              *data;
+} TaskioRun;
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+static void _RunThread(   void * const data);
+
+#if defined(_WIN32)
+static DWORD WINAPI _ThreadStart(LPVOID data);
+#else
+static void        *_ThreadStart(void *data);
+#endif
+
+/******************************************************************************
+global: to library only
+function:
+******************************************************************************/
+/******************************************************************************
+func: taskioGetCoreCount
+
+Get the number of cores the OS lets us use.  At least 1.
+******************************************************************************/
+Gcount taskioGetCoreCount(void)
+{
+   genter;
+
+   Gcount count;
+
+#if defined(_WIN32)
+   SYSTEM_INFO info;
+
+   GetSystemInfo(&info);
+   count = (Gcount) info.dwNumberOfProcessors;
+#else
+   count = (Gcount) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   greturn gMAX(1, count);
+}
+
+/******************************************************************************
+func: taskioLockCreate
+
+Create a lock.
+******************************************************************************/
+TaskioLock *taskioLockCreate(void)
+{
+   genter;
+
+   TaskioLock *lock;
+
+   lock = gmemCreateType(TaskioLock);
+   greturnNullIf(!lock);
+
+#if defined(_WIN32)
+   InitializeSRWLock(&lock->lock);
+#else
+   if (pthread_mutex_init(&lock->lock, NULL) != 0)
+   {
+      gmemDestroy(lock);
+      greturn NULL;
+   }
+#endif
+
+   greturn lock;
+}
+
+/******************************************************************************
+func: taskioLockDestroy
+
+Destroy a lock.  Nothing can be holding it.
+******************************************************************************/
+void taskioLockDestroy(TaskioLock * const lock)
+{
+   genter;
+
+   greturnVoidIf(!lock);
+
+#if !defined(_WIN32)
+   pthread_mutex_destroy(&lock->lock);
+#endif
+
+   gmemDestroy(lock);
+
+   greturn;
+}
+
+/******************************************************************************
+func: taskioLockOff
+
+Let go of the lock.
+******************************************************************************/
+void taskioLockOff(TaskioLock * const lock)
+{
+#if defined(_WIN32)
+   ReleaseSRWLockExclusive(&lock->lock);
+#else
+   pthread_mutex_unlock(&lock->lock);
+#endif
+}
+
+/******************************************************************************
+func: taskioLockOn
+
+Take the lock.  Waits until it is free.
+******************************************************************************/
+void taskioLockOn(TaskioLock * const lock)
+{
+#if defined(_WIN32)
+   AcquireSRWLockExclusive(&lock->lock);
+#else
+   pthread_mutex_lock(&lock->lock);
+#endif
+}
+
+/******************************************************************************
+func: taskioRun
+
+Call func for every index from 0 to count - 1 spread over threadCount
+threads.  The calling thread is one of them.  Returns once all are done.
+If threads can't be made the calling thread does the rest itself.
+******************************************************************************/
+Gb taskioRun(Gcount const threadCount, Gcount const count, TaskioRunFunc const func,
+   void * const data)
+{
+   genter;
+
+   TaskioRun     run;
+   TaskioThread *threadList[taskioRunThreadMAX];
+   Gcount        threadListCount;
+   Gindex        index;
+
+   greturnFalseIf(!func);
+   greturnTrueIf(count <= 0);
+
+   threadListCount = gMIN(threadCount, count);
+   threadListCount = gMIN(threadListCount, taskioRunThreadMAX);
+
+   // Nothing to gain from threads.
+   if (threadListCount <= 1)
+   {
+      forCount(index, count)
+      {
+         func(data, index);
+      }
+
+      greturn gbTRUE;
+   }
+
+   run.lock  = taskioLockCreate();
+   run.index = 0;
+   run.count = count;
+   run.func  = func;
+   run.data  = data;
+
+   if (!run.lock)
+   {
+      forCount(index, count)
+      {
+         func(data, index);
+      }
+
+      greturn gbTRUE;
+   }
+
+   // The calling thread makes up the last one.
+   forCount(index, threadListCount - 1)
+   {
+      threadList[index] = taskioThreadCreate(_RunThread, &run);
+   }
+
+   _RunThread(&run);
+
+   forCount(index, threadListCount - 1)
+   {
+      taskioThreadDestroy(threadList[index]);
+   }
+
+   taskioLockDestroy(run.lock);
+
+   greturn gbTRUE;
+}
+
+/******************************************************************************
+func: taskioSignalCreate
+
+Create a signal.  Threads wait on it until another thread wakes them.
+******************************************************************************/
+TaskioSignal *taskioSignalCreate(void)
+{
+   genter;
+
+   TaskioSignal *signal;
+
+   signal = gmemCreateType(TaskioSignal);
+   greturnNullIf(!signal);
+
+#if defined(_WIN32)
+   InitializeConditionVariable(&signal->signal);
+#else
+   if (pthread_cond_init(&signal->signal, NULL) != 0)
+   {
+      gmemDestroy(signal);
+      greturn NULL;
+   }
+#endif
+
+   greturn signal;
+}
+
+/******************************************************************************
+func: taskioSignalDestroy
+
+Destroy a signal.  Nothing can be waiting on it.
+******************************************************************************/
+void taskioSignalDestroy(TaskioSignal * const signal)
+{
+   genter;
+
+   greturnVoidIf(!signal);
+
+#if !defined(_WIN32)
+   pthread_cond_destroy(&signal->signal);
+#endif
+
+   gmemDestroy(signal);
+
+   greturn;
+}
+
+/******************************************************************************
+func: taskioSignalWait
+
+Wait for a wake.  The lock must be held.  It is let go while waiting and
+held again on return.  Wakes can be spurious so check what is waited for in
+a loop.
+******************************************************************************/
+void taskioSignalWait(TaskioSignal * const signal, TaskioLock * const lock)
+{
+#if defined(_WIN32)
+   SleepConditionVariableSRW(&signal->signal, &lock->lock, INFINITE, 0);
+#else
+   pthread_cond_wait(&signal->signal, &lock->lock);
+#endif
+}
+
+/******************************************************************************
+func: taskioSignalWake
+
+Wake one waiting thread.
+******************************************************************************/
+void taskioSignalWake(TaskioSignal * const signal)
+{
+#if defined(_WIN32)
+   WakeConditionVariable(&signal->signal);
+#else
+   pthread_cond_signal(&signal->signal);
+#endif
+}
+
+/******************************************************************************
+func: taskioSignalWakeAll
+
+Wake all waiting threads.
+******************************************************************************/
+void taskioSignalWakeAll(TaskioSignal * const signal)
+{
+#if defined(_WIN32)
+   WakeAllConditionVariable(&signal->signal);
+#else
+   pthread_cond_broadcast(&signal->signal);
+#endif
+}
+
+/******************************************************************************
+func: taskioThreadCreate
+
+Start a thread running func.  NULL if the thread couldn't be started.
+******************************************************************************/
+TaskioThread *taskioThreadCreate(TaskioThreadFunc const func, void * const data)
+{
+   genter;
+
+   TaskioThread *thread;
+
+   greturnNullIf(!func);
+
+   thread = gmemCreateType(TaskioThread);
+   greturnNullIf(!thread);
+
+   thread->func = func;
+   thread->data = data;
+
+#if defined(_WIN32)
+   thread->thread = CreateThread(NULL, 0, _ThreadStart, thread, 0, NULL);
+   if (!thread->thread)
+#else
+   if (pthread_create(&thread->thread, NULL, _ThreadStart, thread) != 0)
+#endif
+   {
+      gmemDestroy(thread);
+      greturn NULL;
+   }
+
+   greturn thread;
+}
+
+/******************************************************************************
+func: taskioThreadDestroy
+
+Wait for the thread to finish and clean up.
+******************************************************************************/
+void taskioThreadDestroy(TaskioThread * const thread)
+{
+   genter;
+
+   greturnVoidIf(!thread);
+
+#if defined(_WIN32)
+   WaitForSingleObject(thread->thread, INFINITE);
+   CloseHandle(thread->thread);
+#else
+   pthread_join(thread->thread, NULL);
+#endif
+
+   gmemDestroy(thread);
+
+   greturn;
+}
+
+/******************************************************************************
+local:
+function:
+******************************************************************************/
+/******************************************************************************
+func: _RunThread
+
+Take the next index until there are none left.
+******************************************************************************/
+static void _RunThread(void * const data)
+{
+   genter;
+
+   TaskioRun *run;
+   Gindex     index;
+
+   run = (TaskioRun *) data;
+
+   loop
+   {
+      taskioLockOn(run->lock);
+      index = run->index++;
+      taskioLockOff(run->lock);
+
+      breakIf(index >= run->count);
+
+      run->func(run->data, index);
+   }
+
+   greturn;
+}
+
+/******************************************************************************
+func: _ThreadStart
+
+OS thread entry.
+******************************************************************************/
+#if defined(_WIN32)
+static DWORD WINAPI _ThreadStart(LPVOID data)
+#else
+static void        *_ThreadStart(void *data)
+#endif
+{
+   TaskioThread *thread;
+
+   thread = (TaskioThread *) data;
+
+   thread->func(thread->data);
+
+#if defined(_WIN32)
+   return 0;
+#else
+   return NULL;
+#endif
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+
+file:       taskio.h
+author:     Robbert de Groot
+copyright:  2008-2008, Robbert de Groot
+
+description:
+Threads, locks and signals for the codecs that spread work over cores.
+
+******************************************************************************/
+
+/******************************************************************************
+type:
+******************************************************************************/
+typedef struct TaskioLock   TaskioLock;
+typedef struct TaskioSignal TaskioSignal;
+typedef struct TaskioThread TaskioThread;
+
+// Thread body.
+typedef void (*TaskioThreadFunc)(void * const data);
+
+// One piece of a taskioRun.  index is 0 to count - 1.
+typedef void (*TaskioRunFunc)(   void * const data, Gindex const index);
+
+/******************************************************************************
+prototype:
+******************************************************************************/
+Gcount        taskioGetCoreCount(   void);
+
+TaskioLock   *taskioLockCreate(     void);
+void          taskioLockDestroy(    TaskioLock * const lock);
+void          taskioLockOff(        TaskioLock * const lock);
+void          taskioLockOn(         TaskioLock * const lock);
+
+Gb            taskioRun(            Gcount const threadCount, Gcount const count, TaskioRunFunc const func, void * const data);
+
+TaskioSignal *taskioSignalCreate(   void);
+void          taskioSignalDestroy(  TaskioSignal * const signal);
+void          taskioSignalWait(     TaskioSignal * const signal, TaskioLock * const lock);
+void          taskioSignalWake(     TaskioSignal * const signal);
+void          taskioSignalWakeAll(  TaskioSignal * const signal);
+
+TaskioThread *taskioThreadCreate(   TaskioThreadFunc const func, void * const data);
+void          taskioThreadDestroy(  TaskioThread * const thread);